@@ -0,0 +1,267 @@
+// microbenchmarks of the hot kernels, on synthetic input (no video files needed).
+// usage: tim_bench [filter], only benchmarks whose name contains filter are run.
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "background.h"
+#include "colourclassifier.h"
+#include "line.h"
+#include "shadows.h"
+#include "tim.h"
+
+using namespace cv;
+
+// parameters of university.json, so that results don't depend on files in data dir
+static const char* parametersJson = R"({
+    "initialWeight": 0.05, "initialVariance": 20, "learningRate": 0.05, "foregroundThreshold": 14.5,
+    "medianFilterSize": 3, "morphFilterSize": 7,
+    "autoGradientThreshold": false, "edgeCorrection": true, "lambda": 0.02, "tau": 0.0,
+    "alpha": 0.00621, "gradientThreshold": 0.18, "gradientThresholdMultiplier": 0.28,
+    "luminanceThreshold": 1.9, "minObjectSize": 200, "minSegmentSize": 4,
+    "shadowCacheFrames": 0, "chromaticityThreshold": 3.0, "brightnessLow": 0.4, "brightnessHigh": 1.0
+})";
+
+static std::string filter;
+
+// runs 'body' until it took at least minSeconds and minIterations, 'setup' is not timed
+static void benchmark(const std::string& name, const std::function<void()>& body,
+        const std::function<void()>& setup = nullptr, int itemsPerIteration = 1)
+{
+    if (name.find(filter) == std::string::npos)
+        return;
+
+    typedef std::chrono::steady_clock Clock;
+    const double minSeconds = 0.5;
+    const int minIterations = 5;
+
+    // warm-up
+    if (setup) setup();
+    body();
+
+    std::vector<double> times;
+    double total = 0;
+    while (total < minSeconds || int(times.size()) < minIterations)
+    {
+        if (setup) setup();
+
+        auto t1 = Clock::now();
+        body();
+        auto t2 = Clock::now();
+
+        double t = std::chrono::duration<double, std::micro>(t2 - t1).count() / itemsPerIteration;
+        times.push_back(t);
+        total += t * itemsPerIteration / 1e6;
+    }
+
+    std::sort(times.begin(), times.end());
+    std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(14) << times[times.size() / 2] << std::setw(14) << times.front()
+              << std::setw(10) << times.size() << std::endl;
+}
+
+// textured background with some noise
+static Mat syntheticBackground(const Size& size, std::mt19937& rng)
+{
+    Mat background(size, CV_8UC3);
+    randu(background, Scalar::all(60), Scalar::all(180));
+    GaussianBlur(background, background, Size(7, 7), 0);
+
+    std::uniform_int_distribution<int> x(0, size.width - 1), y(0, size.height - 1), c(0, 255);
+    for (int i = 0; i < 50; i++)
+        line(background, Point(x(rng), y(rng)), Point(x(rng), y(rng)), Scalar(c(rng), c(rng), c(rng)), 2);
+
+    return background;
+}
+
+// frame with nObjects cars, each with a shadow next to it. 'foreground' is an ideal mask.
+static void syntheticScene(const Mat& background, int nObjects, std::mt19937& rng, Mat& frame, Mat& foreground)
+{
+    Size size = background.size();
+    background.copyTo(frame);
+    foreground = Mat::zeros(size, CV_8U);
+
+    int w = std::max(size.width / 20, 8), h = std::max(size.height / 20, 8);
+    std::uniform_int_distribution<int> x(0, size.width - 2 * w), y(0, size.height - 2 * h), c(0, 255);
+    for (int i = 0; i < nObjects; i++)
+    {
+        Rect car(x(rng), y(rng), w, h);
+        Rect shadow(car.x + w / 2, car.y + h / 2, w, h);
+
+        Mat shadowRoi = frame(shadow);
+        shadowRoi.convertTo(shadowRoi, -1, 0.6);
+        rectangle(frame, car, Scalar(c(rng), c(rng), c(rng)), FILLED);
+
+        foreground(car).setTo(1);
+        foreground(shadow).setTo(1);
+    }
+}
+
+static void benchmarkBackground(const json11::Json& json, std::mt19937& rng)
+{
+    // mixture model takes 60 bytes per pixel, so the biggest sizes don't fit into caches anymore
+    const std::vector<Size> sizes = { Size(320, 180), Size(640, 360), Size(960, 540), Size(1920, 1080) };
+
+    for (const Size& size: sizes)
+    {
+        std::string suffix = "/" + std::to_string(size.width) + "x" + std::to_string(size.height);
+
+        Mat frame, foreground, fgMask = Mat::zeros(size, CV_8U);
+        syntheticScene(syntheticBackground(size, rng), 20, rng, frame, foreground);
+
+        Background background(size, json);
+        benchmark("background/scalar" + suffix, [&] { background.processFrame(frame, fgMask); });
+#ifdef SIMD
+        benchmark("background/simd" + suffix, [&] { background.processFrameSIMD(frame, fgMask); });
+
+        // kernel alone, single-threaded, to show how it scales with frame size (cache cliffs).
+        // kernel uses aligned loads and stores, so mixtures are allocated the same way as in Background.
+        size_t nGaussianFloats = size.area() * 5 * GAUSSIANS_PER_PIXEL;
+        float* gaussians = nullptr;
+        if (posix_memalign((void**)&gaussians, 16, nGaussianFloats * sizeof(float)) != 0)
+            std::cout << "could not allocate mixtures, skipping background/sse2-kernel" << suffix << std::endl;
+        else
+        {
+            std::fill(gaussians, gaussians + nGaussianFloats, 1.0f);
+            Mat currentBackground(size, CV_8UC3), currentStdDev(size, CV_32F);
+            benchmark("background/sse2-kernel" + suffix, [&]
+            {
+                for (int idx = 0; idx < size.area(); idx += 4)
+                    *((uint32_t*)fgMask.data + idx/4) = processPixels_SSE2(frame.data + 3*idx,
+                            gaussians + 5*GAUSSIANS_PER_PIXEL*idx, currentBackground.data + 3*idx,
+                            (float*)currentStdDev.data + idx, nullptr, 0.05f, 20.0f, 0.05f, 14.5f);
+            });
+            free(gaussians);
+        }
+#endif
+
+        Mat noisyMask(size, CV_8U), filtered;
+        randu(noisyMask, 0, 8);
+        noisyMask = (noisyMask == 0) | foreground;
+        Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(7, 7));
+        benchmark("filter/median3" + suffix, [&] { medianBlur(noisyMask, filtered, 3); });
+        benchmark("filter/erode7" + suffix, [&] { erode(noisyMask, filtered, kernel); });
+    }
+}
+
+static void benchmarkObjects(const json11::Json& json, std::mt19937& rng)
+{
+    const Size size(960, 540);
+    Mat background = syntheticBackground(size, rng);
+    Mat stdDev(size, CV_32F, Scalar(4));
+
+    for (int nObjects: { 5, 50, 200 })
+    {
+        std::string suffix = "/" + std::to_string(nObjects);
+
+        Mat frame, foreground, objectLabels, shadowMask;
+        syntheticScene(background, nObjects, rng, frame, foreground);
+
+        std::vector<MovingObject> objects, detectedObjects;
+        benchmark("detectMovingObjects" + suffix, [&] { Tim::findMovingObjects(foreground, objectLabels, objects); });
+        Tim::findMovingObjects(foreground, objectLabels, detectedObjects);
+        Mat detectedLabels = objectLabels.clone();
+
+        // shadow removal modifies masks of objects and (with edge correction) erodes labels,
+        // so it gets fresh copies every iteration
+        auto resetObjects = [&]
+        {
+            objects = detectedObjects;
+            detectedLabels.copyTo(objectLabels);
+        };
+
+        Shadows regionShadows(json);
+        benchmark("shadows/region" + suffix, [&]
+        {
+            regionShadows.removeShadows(frame, background, stdDev, foreground, objectLabels, objects, shadowMask);
+        }, resetObjects);
+
+        json11::Json::object chromaticityJson = json.object_items();
+        chromaticityJson["shadowEngine"] = "chromaticity";
+        Shadows chromaticityShadows(chromaticityJson);
+        benchmark("shadows/chromaticity" + suffix, [&]
+        {
+            chromaticityShadows.removeShadows(frame, background, stdDev, foreground, objectLabels, objects, shadowMask);
+        }, resetObjects);
+
+        // steps of region engine on their own. ratio is calculated the same way as in Shadows::computeRatio
+        Mat backgroundF, frameF, ratio;
+        background.convertTo(backgroundF, CV_32FC3, 1, 1);
+        frame.convertTo(frameF, CV_32FC3, 1, 1);
+        divide(backgroundF, frameF, ratio);
+
+        Shadows kernels(json);
+        benchmark("shadows/labelSegments" + suffix, [&] { kernels.segmentObjects(ratio, objects); }, resetObjects);
+
+        // shadow mask with blanks: labelled mask from region engine with a quarter of pixels removed
+        resetObjects();
+        regionShadows.removeShadows(frame, background, stdDev, foreground, objectLabels, objects, shadowMask);
+        Mat holes(size, CV_8U), blanks = shadowMask.clone(), filled;
+        randu(holes, 0, 4);
+        blanks.setTo(0, holes == 0);
+        benchmark("shadows/fillInBlanks" + suffix, [&] { kernels.fillInBlanks(foreground, filled); },
+                  [&] { blanks.copyTo(filled); });
+    }
+}
+
+static void benchmarkTracking(std::mt19937& rng)
+{
+    const int n = 100000;
+    std::uniform_int_distribution<int> coord(0, 959), extent(10, 100);
+
+    Line line(0, Point(100, 400), Point(800, 200));
+    std::vector<Rect> rects;
+    for (int i = 0; i < n; i++)
+        rects.emplace_back(coord(rng), coord(rng) / 2, extent(rng), extent(rng));
+
+    int hits = 0;
+    benchmark("Line::intersect", [&]
+    {
+        for (const Rect& rect: rects)
+            hits += line.intersect(rect);
+    }, nullptr, n);
+
+    ColourClassifier colourClassifier;
+    std::uniform_real_distribution<double> channel(0, 255);
+    std::vector<Scalar> colours;
+    for (int i = 0; i < 1000; i++)
+        colours.emplace_back(channel(rng), channel(rng), channel(rng));
+
+    size_t nameLengths = 0;
+    benchmark("ColourClassifier::classifyColour", [&]
+    {
+        for (const Scalar& colour: colours)
+            nameLengths += colourClassifier.classifyColour(colour).size();
+    }, nullptr, colours.size());
+
+    // results are printed so that compiler can't throw the loops away
+    std::cout << "(" << hits << " intersections, " << nameLengths << " characters)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        filter = argv[1];
+
+    std::string err;
+    json11::Json json = json11::Json::parse(parametersJson, err);
+    std::mt19937 rng(42);
+
+    std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(14) << "median [us]"
+              << std::setw(14) << "min [us]" << std::setw(10) << "runs" << std::endl;
+
+    benchmarkBackground(json, rng);
+    benchmarkObjects(json, rng);
+    benchmarkTracking(rng);
+
+    return 0;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
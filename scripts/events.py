@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+
+# subscribes to crossing events published by 'tim --ev=STREAM_ID' and prints them.
+# wire format is described in src/crossingevents.h.
+
+import struct
+from nanomsg import Socket, SUB, SUB_SUBSCRIBE
+
+MAGIC = b'TIME'
+VERSION = 1
+HEADER = struct.Struct('<4sHHII')
+EVENT = struct.Struct('<IId4hBB6x')
+DIRECTIONS = ['natural', 'opposite']
+# same order as dictionary in src/colourclassifier.cpp
+COLOURS = ['white', 'black', 'gray', 'silver', 'dark red']
+
+def decode(message):
+    magic, version, count, streamID, _ = HEADER.unpack_from(message)
+    if magic != MAGIC or version != VERSION or len(message) != HEADER.size + count * EVENT.size:
+        raise ValueError('malformed message')
+
+    events = []
+    for i in range(count):
+        trackID, frameIndex, timestamp, x, y, w, h, direction, colour = \
+            EVENT.unpack_from(message, HEADER.size + i * EVENT.size)
+        events.append({
+            'stream': streamID,
+            'track': trackID,
+            'frame': frameIndex,
+            'timestamp': timestamp,
+            'bbox': (x, y, w, h),
+            'direction': DIRECTIONS[direction],
+            'colour': COLOURS[colour] if colour < len(COLOURS) else None,
+        })
+    return events
+
+if __name__ == '__main__':
+    socket = Socket(SUB)
+    socket.set_string_option(SUB, SUB_SUBSCRIBE, '')
+    socket.connect('ipc:///tmp/tim-events.ipc')
+
+    while True:
+        for event in decode(socket.recv()):
+            print(event)
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+
+# subscribes to metrics published by 'tim --m' and serves the latest snapshot
+# on http://localhost:9464/metrics, so that Prometheus can scrape it.
+# with --print snapshots are printed instead.
+
+import sys, threading
+from http.server import BaseHTTPRequestHandler, HTTPServer
+from nanomsg import Socket, SUB, SUB_SUBSCRIBE
+
+latest = b''
+
+def receive(socket):
+    global latest
+    while True:
+        latest = socket.recv()
+
+class Handler(BaseHTTPRequestHandler):
+    def do_GET(self):
+        if self.path != '/metrics':
+            self.send_error(404)
+            return
+        self.send_response(200)
+        self.send_header('Content-Type', 'text/plain; version=0.0.4')
+        self.end_headers()
+        self.wfile.write(latest)
+
+    def log_message(self, format, *args):
+        pass
+
+if __name__ == '__main__':
+    socket = Socket(SUB)
+    socket.set_string_option(SUB, SUB_SUBSCRIBE, '')
+    socket.connect('ipc:///tmp/tim-metrics.ipc')
+
+    if '--print' in sys.argv:
+        while True:
+            print(socket.recv().decode())
+
+    threading.Thread(target=receive, args=(socket,), daemon=True).start()
+    HTTPServer(('localhost', 9464), Handler).serve_forever()
@@ -1,6 +1,7 @@
 #include <opencv2/imgproc.hpp>
 #include <cstdlib>
 #include "background.h"
+#include "trace.h"
 
 void BackgroundParameters::parse(const json11::Json& json)
 {
@@ -17,9 +18,6 @@ void BackgroundParameters::parse(const json11::Json& json)
 
 Background::Background(const Size& size, const json11::Json& json) :
     etaConst(pow(2 * M_PI, 3.0 / 2.0))
-#ifdef MULTITHREADING
-    ,threadPool(5)
-#endif
 {
     params.parse(json);
 
@@ -33,7 +31,7 @@ Background::Background(const Size& size, const json11::Json& json) :
     currentStdDev = Mat::zeros(size, CV_32F);
 
 #ifdef MULTITHREADING    
-    nThreads = std::thread::hardware_concurrency();
+    nThreads = WorkerPool::size();
 #endif
 }
 
@@ -46,13 +44,15 @@ Background::~Background()
 #endif
 }
 
-void Background::updateParameters(const json11::Json& json)
+void Background::setParameters(const BackgroundParameters& parameters)
 {
-    params.parse(json);
+    // kernel is shared with the snapshot, which is never modified
+    params = parameters;
 }
 
 void Background::processFrame(InputArray _src, OutputArray _foregroundMask)
 {
+    TIM_TRACE_SCOPE("background");
     Mat src = _src.getMat(), foregroundMask = _foregroundMask.getMat();
 
     for (int row = 0; row < src.rows; ++row)
@@ -84,18 +84,29 @@ void Background::processFrame(InputArray _src, OutputArray _foregroundMask)
             *currentStdDevPtr++ = sqrt(gauss.variance);
         }
     }
-
-    if (params.medianFilterSize != 0)
-        medianBlur(foregroundMask, foregroundMask, params.medianFilterSize);
-    if (params.morphFilterSize != 0)
-        erode(foregroundMask, foregroundMask, params.morphFilterKernel);
 }
 
-void Background::processFrameSIMD(InputArray _src, OutputArray _foregroundMask)
+void Background::processFrameSIMD(InputArray _src, OutputArray _foregroundMask, OutputArray _ratio)
 {
+    TIM_TRACE_SCOPE("background");
     Mat src = _src.getMat(), foregroundMask = _foregroundMask.getMat();
     uint32_t nPixels = src.size().area();
 
+    // ratio between background and frame (D in shadow removal) can be calculated in the same pass.
+    // assembly version doesn't support it.
+    float* ratio = nullptr;
+#ifndef ASM
+    if (_ratio.needed())
+    {
+        _ratio.create(src.size(), CV_32FC3);
+        ratio = (float*)_ratio.getMat().data;
+    }
+#endif
+
+    // parameters are read once per frame and workers get their own copy
+    const float learningRate = params.learningRate, initialVariance = params.initialVariance,
+                initialWeight = params.initialWeight, foregroundThreshold = params.foregroundThreshold;
+
 #ifdef MULTITHREADING
     uint32_t pixelsPerThread = nPixels / nThreads;
     std::vector<std::future<void>> results;
@@ -105,19 +116,27 @@ void Background::processFrameSIMD(InputArray _src, OutputArray _foregroundMask)
         uint32_t startIdx = pixelsPerThread * i;
         uint32_t endIdx = startIdx + pixelsPerThread; 
 
-        results.emplace_back(threadPool.enqueue([=]()
+        results.emplace_back(WorkerPool::instance().enqueue([=]()
         {
+            TIM_TRACE_SCOPE("background.worker");
+#ifdef PERF_COUNTERS
+            PerfSample before = PerfCounters::threadCounters().read();
+#endif
             for (uint32_t idx = startIdx; idx < endIdx; idx += 4)
             {
                 uint32_t fgMask = processPixels_SSE2(src.data + 3*idx,
                                             (float*)gaussians + 5*GAUSSIANS_PER_PIXEL*idx,
                                             currentBackground.data + 3*idx,
                                             (float*)currentStdDev.data + idx,
-                                            params.learningRate, params.initialVariance,
-                                            params.initialWeight, params.foregroundThreshold);
+                                            ratio ? ratio + 3*idx : nullptr,
+                                            learningRate, initialVariance,
+                                            initialWeight, foregroundThreshold);
 
                 *((uint32_t*)foregroundMask.data + idx/4) = fgMask;
             }
+#ifdef PERF_COUNTERS
+            workerCounters.add(PerfCounters::threadCounters().read() - before);
+#endif
         }));
     }
 
@@ -130,12 +149,19 @@ void Background::processFrameSIMD(InputArray _src, OutputArray _foregroundMask)
                                             (float*)gaussians + 5*GAUSSIANS_PER_PIXEL*idx,
                                             currentBackground.data + 3*idx,
                                             (float*)currentStdDev.data + idx,
-                                            params.learningRate, params.initialVariance,
-                                            params.initialWeight, params.foregroundThreshold);
+                                            ratio ? ratio + 3*idx : nullptr,
+                                            learningRate, initialVariance,
+                                            initialWeight, foregroundThreshold);
 
         *((uint32_t*)foregroundMask.data + idx/4) = fgMask;
     }
 #endif
+}
+
+void Background::filterForeground(InputOutputArray _foregroundMask)
+{
+    TIM_TRACE_SCOPE("background.filter");
+    Mat foregroundMask = _foregroundMask.getMat();
 
     if (params.medianFilterSize != 0)
         medianBlur(foregroundMask, foregroundMask, params.medianFilterSize);
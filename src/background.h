@@ -3,9 +3,8 @@
 
 #include <opencv2/core.hpp>
 #include "json11.hpp"
-#ifdef MULTITHREADING
-#include "ThreadPool.h"
-#endif
+#include "perfcounters.h"
+#include "workerpool.h"
 
 #define GAUSSIANS_PER_PIXEL 3
 
@@ -50,11 +49,18 @@ class Background
     
         Background(const Size& size, const json11::Json& json);
         ~Background();
-        void updateParameters(const json11::Json& json);
+        // parameters are only replaced between frames
+        void setParameters(const BackgroundParameters& parameters);
         void processFrame(InputArray _src, OutputArray _foregroundMask);
-        void processFrameSIMD(InputArray _src, OutputArray _foregroundMask);
+        void processFrameSIMD(InputArray _src, OutputArray _foregroundMask, OutputArray _ratio = noArray());
+        // median and morphological filtering of foreground mask produced by processFrame*()
+        void filterForeground(InputOutputArray _foregroundMask);
         const Mat& getCurrentBackground() const;
         const Mat& getCurrentStdDev() const;
+#ifdef PERF_COUNTERS
+        // hardware counters of thread pool workers
+        PerfAccumulator& getWorkerCounters() { return workerCounters; }
+#endif
 
     private:
         const float etaConst;
@@ -66,14 +72,16 @@ class Background
         bool processPixel(const Vec3b& rgb, GaussianMixture& mixture);
 #ifdef MULTITHREADING
         int nThreads;
-        ThreadPool threadPool;
+#endif
+#ifdef PERF_COUNTERS
+        PerfAccumulator workerCounters;
 #endif
 };
 
 extern "C" 
 {
     extern uint32_t processPixels_SSE2(const uint8_t* frame, float* gaussian, 
-                                       uint8_t* currentBackground, float* currentStdDev,
+                                       uint8_t* currentBackground, float* currentStdDev, float* ratio,
                                        const float learningRate, const float initialVariance,
                                        const float initialWeight, const float foregroundThreshold);
 }
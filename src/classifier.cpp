@@ -3,6 +3,7 @@
 #include <iostream>
 #endif
 #include "classifier.h"
+#include "trace.h"
 
 Classifier::Classifier(const std::vector<Point>& points, const std::string& directionStr)
 {
@@ -15,8 +16,8 @@ Classifier::Classifier(const std::vector<Point>& points, const std::string& dire
 
 void Classifier::trackObjects(InputArray _frame, InputArray _mask, std::vector<MovingObject>& movingObjects)
 {
+    TIM_TRACE_SCOPE("tracking");
     Mat frame = _frame.getMat(), mask = _mask.getMat();
-    Mat grayFrame;
     cvtColor(frame, grayFrame, COLOR_BGR2GRAY);
 
     // predict next position for already recognised objects
@@ -109,12 +110,14 @@ void Classifier::trackObjects(InputArray _frame, InputArray _mask, std::vector<M
         std::swap(obj.prevFeatures, obj.features);
     }
     
-    prevFrame = grayFrame.clone();
+    // swap instead of clone, so both buffers get reused in the next frame
+    std::swap(prevFrame, grayFrame);
     frameCounter++;
 }
 
 void Classifier::checkCollisions()
 {
+    TIM_TRACE_SCOPE("counting");
     for (auto& line: collisionLines)
     {
         bool anyOfObjectsCrossesTheLine = false;
@@ -133,17 +136,21 @@ void Classifier::checkCollisions()
 
 void Classifier::updateCounters()
 {
+    crossings.clear();
     for (auto& obj: classifiedObjects)
     {
         if (obj.collisions.size() == 2 && !obj.alreadyCounted)
         {
             uint32_t line0Time = obj.collisions[0];
             uint32_t line1Time = obj.collisions[1];
-            if (line0Time < line1Time)
+            bool natural = line0Time < line1Time;
+            if (natural)
                 naturalDirection++;
             else
                 oppositeDirection++;
 
+            // colour is known only if colours are classified
+            crossings.push_back({ obj.ID, natural, obj.selector, colourClassifier.colourIndex(obj.colourString) });
             obj.alreadyCounted = true;
         }
     }
@@ -151,6 +158,7 @@ void Classifier::updateCounters()
 
 void Classifier::classifyColours(InputArray _frame)
 {
+    TIM_TRACE_SCOPE("classifyColours");
     Mat frame = _frame.getMat();
 
     for (auto& obj: classifiedObjects)
@@ -6,6 +6,7 @@
 #include "line.h"
 #include "direction.h"
 #include "colourclassifier.h"
+#include "crossingevents.h"
 
 using namespace cv;
 
@@ -23,11 +24,18 @@ class Classifier
         void drawCollisionLines(InputOutputArray _frame);
         void drawCounters(InputOutputArray _frame);
 
+        uint32_t naturalCount() const { return naturalDirection.count(); }
+        uint32_t oppositeCount() const { return oppositeDirection.count(); }
+        size_t activeTracks() const { return classifiedObjects.size(); }
+        // crossings counted by the last updateCounters() call
+        const std::vector<Crossing>& lastCrossings() const { return crossings; }
+
     private:
-        Mat prevFrame;
+        Mat prevFrame, grayFrame;
         int frameCounter = 0;
         int objCounter = 0;
         std::vector<MovingObject> classifiedObjects;
+        std::vector<Crossing> crossings;
 
         Line collisionLines[2];
         // naturalDirection goes from line #0 to line #1
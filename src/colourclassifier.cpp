@@ -33,6 +33,15 @@ float ColourClassifier::distance(const Scalar& a, const Scalar& b)
     return sqrt(distance);
 }
 
+int ColourClassifier::colourIndex(const std::string& name) const
+{
+    for (size_t i = 0; i < colourDictionary.size(); i++)
+        if (std::get<1>(colourDictionary[i]) == name)
+            return int(i);
+
+    return -1;
+}
+
 std::string ColourClassifier::classifyColour(const Scalar& bgr)
 {
     auto lab = BGR2Lab(bgr[0], bgr[1], bgr[2]);
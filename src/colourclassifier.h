@@ -17,6 +17,8 @@ class ColourClassifier
     public:
         ColourClassifier();
         std::string classifyColour(const Scalar& colour);
+        // position of colour in dictionary, -1 if there's no such colour
+        int colourIndex(const std::string& name) const;
 };
 
 #endif
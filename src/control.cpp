@@ -0,0 +1,63 @@
+#include <nanomsg/nn.h>
+#include <iostream>
+#include "control.h"
+
+void ParameterSnapshot::parse(const json11::Json& json)
+{
+    background.parse(json);
+    shadows.parse(json);
+    loops.parse(json);
+    removeShadows = json["shadowDetection"].bool_value();
+}
+
+ControlChannel::ControlChannel(int socket) :
+    socket(socket), pending(nullptr), stopping(false)
+{
+    // receive times out, so that the thread notices it's being stopped
+    int timeout = 100;
+    nn_setsockopt(socket, NN_SOL_SOCKET, NN_RCVTIMEO, &timeout, sizeof(timeout));
+
+    thread = std::thread(&ControlChannel::run, this);
+}
+
+ControlChannel::~ControlChannel()
+{
+    stopping = true;
+    thread.join();
+
+    delete pending.exchange(nullptr);
+}
+
+std::unique_ptr<ParameterSnapshot> ControlChannel::poll()
+{
+    // snapshot taken out of 'pending' is owned only by the caller
+    return std::unique_ptr<ParameterSnapshot>(pending.exchange(nullptr, std::memory_order_acquire));
+}
+
+void ControlChannel::run()
+{
+    while (!stopping)
+    {
+        void* buf = nullptr;
+        int nbytes = nn_recv(socket, &buf, NN_MSG, 0);
+        if (nbytes < 0)
+            continue;
+
+        std::string err;
+        json11::Json json = json11::Json::parse(std::string((const char*)buf, nbytes), err);
+        nn_freemsg(buf);
+        if (!err.empty())
+        {
+            std::cout << "invalid parameters message: " << err << std::endl;
+            continue;
+        }
+
+        ParameterSnapshot* snapshot = new ParameterSnapshot();
+        snapshot->parse(json);
+
+        // snapshot that processing thread didn't pick up yet was never seen by it
+        delete pending.exchange(snapshot, std::memory_order_acq_rel);
+    }
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,49 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "background.h"
+#include "json11.hpp"
+#include "loopdetector.h"
+#include "shadows.h"
+
+// everything that can be tuned while Tim is running, parsed from one JSON message.
+// it's never modified after it's published.
+struct ParameterSnapshot
+{
+    BackgroundParameters background;
+    ShadowsParameters shadows;
+    LoopDetectorParameters loops;
+    bool removeShadows;
+
+    void parse(const json11::Json& json);
+};
+
+// receives parameter updates (e.g. from scripts/editor.py) on nanomsg socket in its
+// own thread, so that JSON parsing and derived values like morphological kernel
+// are computed off the processing thread. snapshots are handed over through one atomic
+// pointer: control thread swaps a new one in, processing thread takes it out between
+// frames. if processing thread doesn't keep up, only the newest snapshot is kept.
+class ControlChannel
+{
+    public:
+        explicit ControlChannel(int socket);
+        ~ControlChannel();
+
+        // the newest snapshot published since the last call, nullptr if there's none
+        std::unique_ptr<ParameterSnapshot> poll();
+
+    private:
+        int socket;
+        std::atomic<ParameterSnapshot*> pending;
+        std::atomic<bool> stopping;
+        std::thread thread;
+
+        void run();
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,117 @@
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+#include <algorithm>
+#include <cstring>
+#include "crossingevents.h"
+
+// all supported targets are little-endian, so structs are copied as they are
+
+// event log stores directions and colours without conversion
+static_assert(int(CrossingEvents::NATURAL) == int(EventLog::NATURAL) &&
+              int(CrossingEvents::OPPOSITE) == int(EventLog::OPPOSITE) &&
+              CrossingEvents::unknownColour == EventLog::unknownColour, "event log and stream disagree");
+
+static int16_t clampCoordinate(int value)
+{
+    return int16_t(std::min(std::max(value, int(INT16_MIN)), int(INT16_MAX)));
+}
+
+void CrossingEvents::encode(uint32_t streamID, uint32_t frameIndex, double timestamp,
+                            const std::vector<Crossing>& crossings, std::vector<uint8_t>& buffer)
+{
+    CV_Assert(crossings.size() <= UINT16_MAX);
+
+    BatchHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.count = uint16_t(crossings.size());
+    header.streamID = streamID;
+
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(BatchHeader) + crossings.size() * sizeof(Event));
+    std::memcpy(buffer.data() + offset, &header, sizeof(header));
+    offset += sizeof(header);
+
+    for (const Crossing& crossing: crossings)
+    {
+        Event event = {};
+        event.trackID = crossing.trackID;
+        event.frameIndex = frameIndex;
+        event.timestamp = timestamp;
+        event.x = clampCoordinate(crossing.boundingBox.x);
+        event.y = clampCoordinate(crossing.boundingBox.y);
+        event.width = clampCoordinate(crossing.boundingBox.width);
+        event.height = clampCoordinate(crossing.boundingBox.height);
+        event.direction = crossing.natural ? NATURAL : OPPOSITE;
+        event.colour = crossing.colour >= 0 && crossing.colour < unknownColour ? uint8_t(crossing.colour) : unknownColour;
+
+        std::memcpy(buffer.data() + offset, &event, sizeof(event));
+        offset += sizeof(event);
+    }
+}
+
+bool CrossingEvents::decode(const void* data, size_t size, BatchHeader& header, std::vector<Event>& events)
+{
+    if (size < sizeof(BatchHeader))
+        return false;
+
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version ||
+        size != sizeof(BatchHeader) + header.count * sizeof(Event))
+        return false;
+
+    events.resize(header.count);
+    if (header.count > 0)
+        std::memcpy(events.data(), (const uint8_t*)data + sizeof(BatchHeader), header.count * sizeof(Event));
+
+    return true;
+}
+
+void CrossingEvents::toLogRecords(const std::vector<Crossing>& crossings, std::vector<EventLog::Record>& records)
+{
+    records.clear();
+    for (const Crossing& crossing: crossings)
+    {
+        EventLog::Record record = {};
+        record.direction = crossing.natural ? NATURAL : OPPOSITE;
+        record.colour = crossing.colour >= 0 && crossing.colour < unknownColour ? uint8_t(crossing.colour) : unknownColour;
+        record.trackID = crossing.trackID;
+        record.x = clampCoordinate(crossing.boundingBox.x);
+        record.y = clampCoordinate(crossing.boundingBox.y);
+        record.width = clampCoordinate(crossing.boundingBox.width);
+        record.height = clampCoordinate(crossing.boundingBox.height);
+        records.push_back(record);
+    }
+}
+
+EventPublisher::EventPublisher(const std::string& address, uint32_t streamID) :
+    streamID(streamID)
+{
+    socket = nn_socket(AF_SP, NN_PUB);
+    if (socket >= 0 && nn_bind(socket, address.c_str()) < 0)
+    {
+        nn_close(socket);
+        socket = -1;
+    }
+}
+
+EventPublisher::~EventPublisher()
+{
+    if (socket >= 0)
+        nn_close(socket);
+}
+
+void EventPublisher::publish(uint32_t frameIndex, double timestamp, const std::vector<Crossing>& crossings)
+{
+    if (socket < 0 || crossings.empty())
+        return;
+
+    // buffer keeps its capacity, so steady state doesn't allocate
+    buffer.clear();
+    CrossingEvents::encode(streamID, frameIndex, timestamp, crossings, buffer);
+
+    if (nn_send(socket, buffer.data(), buffer.size(), NN_DONTWAIT) < 0)
+        failed++;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,95 @@
+#ifndef CROSSINGEVENTS_H
+#define CROSSINGEVENTS_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "eventlog.h"
+
+using namespace cv;
+
+// crossing counted by Classifier or LoopDetector
+struct Crossing
+{
+    uint32_t trackID;
+    bool natural;
+    Rect boundingBox;
+    // index into ColourClassifier dictionary, -1 if unknown
+    int colour;
+};
+
+// binary stream of crossing events. every message carries one frame worth of events:
+// BatchHeader followed by 'count' Event records. integers are little-endian, structs
+// have no padding. scripts/events.py decodes it in Python.
+namespace CrossingEvents
+{
+    const char magic[4] = { 'T', 'I', 'M', 'E' };
+    const uint16_t version = 1;
+
+    enum Direction : uint8_t
+    {
+        NATURAL = 0,
+        OPPOSITE = 1
+    };
+
+    const uint8_t unknownColour = 255;
+
+    struct BatchHeader
+    {
+        char magic[4];
+        uint16_t version;
+        uint16_t count;
+        uint32_t streamID;
+        uint32_t reserved;
+    };
+
+    struct Event
+    {
+        uint32_t trackID;
+        uint32_t frameIndex;
+        // position in video [ms]
+        double timestamp;
+        // bounding box in downscaled frame
+        int16_t x, y, width, height;
+        uint8_t direction;
+        uint8_t colour;
+        uint8_t reserved[6];
+    };
+
+    static_assert(sizeof(BatchHeader) == 16, "unexpected padding in BatchHeader");
+    static_assert(sizeof(Event) == 32, "unexpected padding in Event");
+
+    // appends one message to 'buffer'
+    void encode(uint32_t streamID, uint32_t frameIndex, double timestamp,
+                const std::vector<Crossing>& crossings, std::vector<uint8_t>& buffer);
+    // returns false if message is malformed or has unknown version
+    bool decode(const void* data, size_t size, BatchHeader& header, std::vector<Event>& events);
+    // crossings as event log records for EventLogWriter::write(), replaces content of 'records'
+    void toLogRecords(const std::vector<Crossing>& crossings, std::vector<EventLog::Record>& records);
+}
+
+// publishes crossing events on a nanomsg PUB socket. sending never blocks,
+// messages for subscribers that can't keep up are dropped by nanomsg.
+class EventPublisher
+{
+    public:
+        EventPublisher(const std::string& address, uint32_t streamID);
+        ~EventPublisher();
+
+        bool isOpened() const { return socket >= 0; }
+
+        // one message per frame, nothing is sent for frames without crossings
+        void publish(uint32_t frameIndex, double timestamp, const std::vector<Crossing>& crossings);
+        uint64_t messagesFailed() const { return failed; }
+
+    private:
+        int socket;
+        uint32_t streamID;
+        uint64_t failed = 0;
+        std::vector<uint8_t> buffer;
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -24,6 +24,7 @@ class Direction
         Direction(const std::string& directionStr);
         Direction(const Direction& direction) = default;
         std::string prettyString();
+        uint32_t count() const { return counter; }
         Direction operator!();
         Direction operator++(int);
         Direction& operator=(const Direction&& other);
@@ -0,0 +1,88 @@
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include "display.h"
+#include "trace.h"
+
+const Mat& Compositor::compose(const DisplayViews& views)
+{
+    TIM_TRACE_SCOPE("compose");
+    Size size = views.frame.size();
+    canvas.create(size.height * 2, size.width * 2, CV_8UC3);
+
+    views.frame.copyTo(canvas(Rect(Point(0, 0), size)));
+
+    views.foregroundMask.convertTo(scaledMask, CV_8U, 255);
+    cvtColor(scaledMask, canvas(Rect(Point(size.width, 0), size)), COLOR_GRAY2BGR);
+
+    views.background.copyTo(canvas(Rect(Point(0, size.height), size)));
+
+    views.shadowMask.convertTo(scaledMask, CV_8U, 255/2);
+    cvtColor(scaledMask, canvas(Rect(Point(size.width, size.height), size)), COLOR_GRAY2BGR);
+
+    return canvas;
+}
+
+Display::Display(double refreshRate) :
+    refreshInterval(std::max(1, int(1000 / refreshRate))), stopping(false)
+{
+    thread = std::thread(&Display::run, this);
+}
+
+Display::~Display()
+{
+    stopping = true;
+    thread.join();
+}
+
+void Display::publish()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(back, latest);
+    latestIsNew = true;
+}
+
+bool Display::pollKey(char& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (keys.empty())
+        return false;
+
+    key = keys.front();
+    keys.pop_front();
+    return true;
+}
+
+void Display::run()
+{
+    // all HighGUI calls are made from this thread
+    namedWindow("OpenCV", WINDOW_AUTOSIZE);
+
+    while (!stopping)
+    {
+        bool newFrame = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (latestIsNew)
+            {
+                std::swap(latest, front);
+                latestIsNew = false;
+                newFrame = true;
+            }
+        }
+
+        // composing happens outside of the lock, processing thread can publish in the meantime
+        if (newFrame)
+            imshow("OpenCV", compositor.compose(front));
+
+        int key = waitKey(refreshInterval);
+        if (key >= 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            keys.push_back(char(key));
+        }
+    }
+
+    destroyWindow("OpenCV");
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
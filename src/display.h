@@ -0,0 +1,66 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace cv;
+
+// everything that's shown for one processed frame
+struct DisplayViews
+{
+    Mat frame, foregroundMask, background, shadowMask;
+};
+
+// composes 2x2 debug view (annotated frame, foreground mask, background, shadow mask)
+// into one canvas that is allocated once
+class Compositor
+{
+    public:
+        const Mat& compose(const DisplayViews& views);
+
+    private:
+        Mat canvas, scaledMask;
+};
+
+// shows processed frames from its own thread, at display refresh rate, so that
+// processing is not throttled by GUI. it also handles keyboard, processing thread
+// polls for keys that were pressed in the meantime.
+class Display
+{
+    public:
+        explicit Display(double refreshRate = 60);
+        ~Display();
+
+        // buffers for the next frame. they're owned by processing thread until publish() is called.
+        DisplayViews& backBuffer() { return back; }
+        // make back buffer the latest completed frame
+        void publish();
+
+        bool pollKey(char& key);
+
+    private:
+        // triple buffering: processing thread fills 'back', render thread shows 'front',
+        // 'latest' is the most recent completed frame not picked up by render thread yet
+        DisplayViews back, latest, front;
+        bool latestIsNew = false;
+
+        int refreshInterval;
+        Compositor compositor;
+
+        std::mutex mutex;
+        std::deque<char> keys;
+
+        std::atomic<bool> stopping;
+        std::thread thread;
+
+        void run();
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
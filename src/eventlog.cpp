@@ -0,0 +1,308 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "eventlog.h"
+
+using namespace EventLog;
+
+static double unixTime()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string EventLog::segmentFileName(const std::string& baseName, uint32_t segmentNumber)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "%06u", segmentNumber);
+    return baseName + "." + number + ".tlog";
+}
+
+size_t EventLog::segmentSize(uint32_t recordCapacity)
+{
+    return sizeof(SegmentHeader) + indexCapacity * sizeof(IndexEntry) + size_t(recordCapacity) * sizeof(Record);
+}
+
+EventLogWriter::~EventLogWriter()
+{
+    close();
+}
+
+bool EventLogWriter::open(const std::string& baseName, uint32_t streamID, uint32_t recordCapacity,
+                          uint32_t bucketSeconds, double snapshotSeconds)
+{
+    close();
+
+    this->baseName = baseName;
+    this->streamID = streamID;
+    this->recordCapacity = std::max(recordCapacity, 1u);
+    this->bucketSeconds = std::max(bucketSeconds, 1u);
+    this->snapshotSeconds = snapshotSeconds;
+    lastSnapshot = 0;
+
+    // never touch segments of previous runs, they might be read at the moment
+    struct stat st;
+    segmentNumber = 0;
+    while (stat(segmentFileName(baseName, segmentNumber).c_str(), &st) == 0)
+        segmentNumber++;
+
+    if (!createSegment(segmentNumber, current))
+        return false;
+
+    useSegment(current);
+    startRotation(Segment());
+    return true;
+}
+
+void EventLogWriter::close()
+{
+    if (rotation.joinable())
+        rotation.join();
+
+    closeSegment(current, true);
+    // next segment was created in advance and nothing was written to it
+    if (next.fd >= 0)
+    {
+        closeSegment(next, false);
+        unlink(segmentFileName(baseName, segmentNumber + 1).c_str());
+    }
+
+    header = nullptr;
+    index = nullptr;
+    records = nullptr;
+}
+
+bool EventLogWriter::createSegment(uint32_t number, Segment& segment) const
+{
+    std::string fileName = segmentFileName(baseName, number);
+    size_t size = segmentSize(recordCapacity);
+
+    // blocks are allocated upfront, so a full disk can't turn into SIGBUS later
+    segment.fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (segment.fd < 0 || posix_fallocate(segment.fd, 0, size) != 0)
+    {
+        std::cout << "could not create " << fileName << std::endl;
+        closeSegment(segment, false);
+        return false;
+    }
+
+    segment.mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+    if (segment.mapping == MAP_FAILED)
+    {
+        segment.mapping = nullptr;
+        std::cout << "could not map " << fileName << std::endl;
+        closeSegment(segment, false);
+        return false;
+    }
+
+    SegmentHeader* header = (SegmentHeader*)segment.mapping;
+    std::memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->segmentNumber = number;
+    header->streamID = streamID;
+    header->recordCapacity = recordCapacity;
+    header->indexCapacity = indexCapacity;
+    header->bucketSeconds = bucketSeconds;
+
+    return true;
+}
+
+void EventLogWriter::closeSegment(Segment& segment, bool sync) const
+{
+    if (segment.mapping)
+    {
+        if (sync)
+            msync(segment.mapping, segmentSize(recordCapacity), MS_SYNC);
+        munmap(segment.mapping, segmentSize(recordCapacity));
+    }
+    if (segment.fd >= 0)
+        ::close(segment.fd);
+
+    segment = Segment();
+}
+
+void EventLogWriter::useSegment(const Segment& segment)
+{
+    header = (SegmentHeader*)segment.mapping;
+    index = (IndexEntry*)(header + 1);
+    records = (Record*)(index + indexCapacity);
+}
+
+void EventLogWriter::startRotation(Segment previous)
+{
+    uint32_t nextNumber = segmentNumber + 1;
+    rotation = std::thread([this, previous, nextNumber]() mutable
+    {
+        closeSegment(previous, true);
+        createSegment(nextNumber, next);
+    });
+}
+
+void EventLogWriter::append(const Record& record)
+{
+    int64_t bucket = int64_t(std::floor(record.time / bucketSeconds));
+    bool newBucket = header->indexCount == 0 || index[header->indexCount - 1].bucket != bucket;
+
+    if (header->recordCount == header->recordCapacity || (newBucket && header->indexCount == header->indexCapacity))
+    {
+        // next segment is normally ready long before this one is full, so this doesn't wait
+        rotation.join();
+        if (!next.mapping)
+        {
+            close();
+            return;
+        }
+
+        Segment previous = current;
+        current = next;
+        next = Segment();
+        segmentNumber++;
+        useSegment(current);
+        startRotation(previous);
+        newBucket = true;
+    }
+
+    uint32_t position = header->recordCount;
+    records[position] = record;
+    if (newBucket)
+        index[header->indexCount] = { bucket, position, 0 };
+
+    if (position == 0)
+        header->firstTime = record.time;
+    header->lastTime = record.time;
+
+    // readers of a live log must not see counters before data they cover
+    std::atomic_thread_fence(std::memory_order_release);
+    if (newBucket)
+        header->indexCount++;
+    header->recordCount = position + 1;
+}
+
+void EventLogWriter::write(uint32_t frameIndex, const std::vector<Record>& crossings,
+                           uint32_t naturalCount, uint32_t oppositeCount)
+{
+    if (!isOpened())
+        return;
+
+    double now = unixTime();
+
+    // counts passed in already include crossings of this frame
+    uint32_t natural = naturalCount, opposite = oppositeCount;
+    for (const Record& crossing: crossings)
+        (crossing.direction == NATURAL ? natural : opposite)--;
+
+    for (Record record: crossings)
+    {
+        (record.direction == NATURAL ? natural : opposite)++;
+
+        record.type = CROSSING;
+        record.frameIndex = frameIndex;
+        record.time = now;
+        record.naturalCount = natural;
+        record.oppositeCount = opposite;
+        append(record);
+        if (!isOpened())
+            return;
+    }
+
+    if (now - lastSnapshot >= snapshotSeconds)
+    {
+        Record record = {};
+        record.type = SNAPSHOT;
+        record.frameIndex = frameIndex;
+        record.time = now;
+        record.naturalCount = naturalCount;
+        record.oppositeCount = oppositeCount;
+        append(record);
+        lastSnapshot = now;
+
+        // page cache survives crash of Tim, this is for crash of the machine
+        if (isOpened())
+            msync(current.mapping, segmentSize(recordCapacity), MS_ASYNC);
+    }
+}
+
+EventLogReader::~EventLogReader()
+{
+    for (Segment& segment: segments)
+        munmap(segment.mapping, segment.size);
+}
+
+bool EventLogReader::open(const std::string& baseName)
+{
+    for (uint32_t segmentNumber = 0; ; segmentNumber++)
+    {
+        std::string fileName = segmentFileName(baseName, segmentNumber);
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            break;
+
+        struct stat st;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(SegmentHeader))
+            mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            std::cout << "could not map " << fileName << std::endl;
+            continue;
+        }
+
+        Segment segment = { mapping, size_t(st.st_size), (const SegmentHeader*)mapping, nullptr, nullptr };
+        const SegmentHeader* header = segment.header;
+        if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version ||
+            header->indexCapacity != indexCapacity || segment.size < segmentSize(header->recordCapacity))
+        {
+            std::cout << fileName << " is not a valid event log segment" << std::endl;
+            munmap(mapping, segment.size);
+            continue;
+        }
+
+        segment.index = (const IndexEntry*)(header + 1);
+        segment.records = (const Record*)(segment.index + indexCapacity);
+        segments.push_back(segment);
+    }
+
+    return !segments.empty();
+}
+
+void EventLogReader::forEach(double from, double to, const std::function<void(const Record&)>& callback) const
+{
+    for (const Segment& segment: segments)
+    {
+        const SegmentHeader* header = segment.header;
+        uint32_t recordCount = std::min(header->recordCount, header->recordCapacity);
+        uint32_t indexCount = std::min(header->indexCount, header->indexCapacity);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (recordCount == 0 || header->lastTime < from || header->firstTime >= to)
+            continue;
+
+        // skip to the first bucket that can contain 'from'. it's clamped to time of the first
+        // record, so open ranges (-inf) or NaN don't overflow the conversion to bucket number.
+        double start = from > header->firstTime ? from : header->firstTime;
+        int64_t bucket = int64_t(std::floor(start / header->bucketSeconds));
+        const IndexEntry* entry = std::upper_bound(segment.index, segment.index + indexCount, bucket,
+                [](int64_t bucket, const IndexEntry& entry) { return bucket < entry.bucket; });
+        uint32_t first = entry == segment.index ? 0 : (entry - 1)->firstRecord;
+
+        for (uint32_t position = first; position < recordCount; position++)
+        {
+            const Record& record = segment.records[position];
+            if (record.time >= to)
+                break;
+            if (record.time >= from)
+                callback(record);
+        }
+    }
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
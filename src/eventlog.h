@@ -0,0 +1,162 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// durable log of crossings and count snapshots. it's split into segments
+// <baseName>.<number>.tlog, each one is allocated to its full size when created and
+// memory-mapped, so appending a record is just a copy into page cache. segment starts
+// with SegmentHeader, followed by time bucket index and fixed-size records.
+// counters in header are updated only after record itself is written, so a crash
+// loses at most the records of the frame being written. when records or index
+// entries run out, writer continues in a new segment.
+// it doesn't depend on OpenCV, so that tim_log can be built from this file alone.
+namespace EventLog
+{
+    const char magic[4] = { 'T', 'I', 'M', 'L' };
+    const uint32_t version = 1;
+    const uint32_t indexCapacity = 4096;
+
+    // same values as CrossingEvents::Direction and CrossingEvents::unknownColour
+    enum Direction : uint8_t
+    {
+        NATURAL = 0,
+        OPPOSITE = 1
+    };
+
+    const uint8_t unknownColour = 255;
+
+    enum RecordType : uint8_t
+    {
+        CROSSING = 1,
+        SNAPSHOT = 2
+    };
+
+    struct SegmentHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t segmentNumber;
+        uint32_t streamID;
+        uint32_t recordCapacity;
+        uint32_t indexCapacity;
+        uint32_t bucketSeconds;
+        uint32_t recordCount;
+        uint32_t indexCount;
+        uint32_t reserved;
+        // unix time of the first and the last record [s]
+        double firstTime, lastTime;
+        uint8_t padding[8];
+    };
+
+    // first record with time in given bucket
+    struct IndexEntry
+    {
+        int64_t bucket;     // unix time / bucketSeconds
+        uint32_t firstRecord;
+        uint32_t reserved;
+    };
+
+    struct Record
+    {
+        uint8_t type;
+        uint8_t direction;  // Direction, crossings only
+        uint8_t colour;     // crossings only, unknownColour if unknown
+        uint8_t reserved;
+        uint32_t frameIndex;
+        double time;        // unix time [s]
+        // counts since Tim started, including this crossing
+        uint32_t naturalCount, oppositeCount;
+        // crossings only
+        uint32_t trackID;
+        int16_t x, y, width, height;
+        uint32_t reserved2;
+    };
+
+    static_assert(sizeof(SegmentHeader) == 64, "unexpected padding in SegmentHeader");
+    static_assert(sizeof(IndexEntry) == 16, "unexpected padding in IndexEntry");
+    static_assert(sizeof(Record) == 40, "unexpected padding in Record");
+
+    std::string segmentFileName(const std::string& baseName, uint32_t segmentNumber);
+    size_t segmentSize(uint32_t recordCapacity);
+}
+
+class EventLogWriter
+{
+    public:
+        ~EventLogWriter();
+
+        // existing segments are kept, writing continues in a new one
+        bool open(const std::string& baseName, uint32_t streamID, uint32_t recordCapacity = 1 << 16,
+                  uint32_t bucketSeconds = 60, double snapshotSeconds = 60);
+        void close();
+        bool isOpened() const { return header != nullptr; }
+
+        // called every frame. appends crossings of this frame and a snapshot of counts
+        // if the last one is older than snapshotSeconds. crossings come from
+        // CrossingEvents::toLogRecords(), time and counts are filled in here.
+        void write(uint32_t frameIndex, const std::vector<EventLog::Record>& crossings,
+                   uint32_t naturalCount, uint32_t oppositeCount);
+
+    private:
+        struct Segment
+        {
+            int fd = -1;
+            void* mapping = nullptr;
+        };
+
+        std::string baseName;
+        uint32_t streamID, recordCapacity, bucketSeconds;
+        double snapshotSeconds, lastSnapshot = 0;
+        uint32_t segmentNumber = 0;
+
+        Segment current;
+        EventLog::SegmentHeader* header = nullptr;
+        EventLog::IndexEntry* index = nullptr;
+        EventLog::Record* records = nullptr;
+
+        // creating, allocating and syncing segments is slow, so it's done on a background
+        // thread: while one segment is being filled, the previous one is flushed and closed
+        // and the next one is created. rotation only swaps mappings.
+        std::thread rotation;
+        Segment next;
+
+        bool createSegment(uint32_t number, Segment& segment) const;
+        void closeSegment(Segment& segment, bool sync) const;
+        void useSegment(const Segment& segment);
+        void startRotation(Segment previous);
+        void append(const EventLog::Record& record);
+};
+
+class EventLogReader
+{
+    public:
+        ~EventLogReader();
+
+        // maps all segments of the log, returns false if there are none
+        bool open(const std::string& baseName);
+        size_t segmentsNum() const { return segments.size(); }
+
+        // calls 'callback' for every record with from <= time < to, in order of writing
+        void forEach(double from, double to, const std::function<void(const EventLog::Record&)>& callback) const;
+
+    private:
+        struct Segment
+        {
+            void* mapping;
+            size_t size;
+            const EventLog::SegmentHeader* header;
+            const EventLog::IndexEntry* index;
+            const EventLog::Record* records;
+        };
+
+        std::vector<Segment> segments;
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
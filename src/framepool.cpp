@@ -0,0 +1,117 @@
+#include <new>
+#include "framepool.h"
+
+FramePool* FramePool::instance()
+{
+    static FramePool* pool = new FramePool();
+    return pool;
+}
+
+size_t FramePool::sizeClass(size_t size)
+{
+    // round up to quarter of power of two, so that at most ~20% of memory is wasted
+    // and buffers of slightly different sizes (e.g. bounding boxes of objects) share class
+    size_t power = 1;
+    while ((power << 1) <= size)
+        power <<= 1;
+
+    size_t step = std::max<size_t>(power / 4, 1);
+    return (size + step - 1) / step * step;
+}
+
+UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+        int /*flags*/, UMatUsageFlags /*usageFlags*/) const
+{
+    // calculate steps and total size the same way as OpenCV's default allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data0 && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    uchar* data = (uchar*)data0;
+    size_t capacity = total;
+    UMatData* u = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!data && total >= minPooledSize)
+        {
+            capacity = sizeClass(total);
+            auto it = freeBuffers.find(capacity);
+            if (it != freeBuffers.end() && !it->second.empty())
+            {
+                data = it->second.back();
+                it->second.pop_back();
+            }
+        }
+
+        if (!freeHeaders.empty())
+        {
+            u = freeHeaders.back();
+            freeHeaders.pop_back();
+        }
+    }
+
+    if (!data)
+        data = (uchar*)fastMalloc(capacity);
+
+    if (u)
+        u = new (u) UMatData(this);
+    else
+        u = new UMatData(this);
+
+    u->data = u->origdata = data;
+    u->size = capacity;
+    if (data0)
+        u->flags |= UMatData::USER_ALLOCATED;
+
+    return u;
+}
+
+bool FramePool::allocate(UMatData* u, int /*accessFlags*/, UMatUsageFlags /*usageFlags*/) const
+{
+    return u != nullptr;
+}
+
+void FramePool::deallocate(UMatData* u) const
+{
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    uchar* data = (u->flags & UMatData::USER_ALLOCATED) ? nullptr : u->origdata;
+    size_t size = u->size;
+    u->~UMatData();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // small buffers are never pooled, so they mustn't create a size class either
+    // (per-object ROIs come in many sizes)
+    if (data && size >= minPooledSize)
+    {
+        auto& buffers = freeBuffers[size];
+        if (buffers.size() < maxBuffersPerClass)
+            buffers.push_back(data);
+        else
+            fastFree(data);
+    }
+    else if (data)
+        fastFree(data);
+
+    freeHeaders.push_back(u);
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,42 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <opencv2/core.hpp>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace cv;
+
+// Mat allocator that keeps released buffers and hands them out again.
+// pipeline allocates the same full-frame and object-sized buffers every frame,
+// so after a couple of frames nearly all Mat allocations are served from the pool.
+class FramePool : public MatAllocator
+{
+    public:
+        // pool has to outlive every Mat allocated with it, so it's never destroyed
+        static FramePool* instance();
+
+        UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                int flags, UMatUsageFlags usageFlags) const override;
+        bool allocate(UMatData* data, int accessFlags, UMatUsageFlags usageFlags) const override;
+        void deallocate(UMatData* data) const override;
+
+    private:
+        FramePool() = default;
+
+        // small buffers are left to malloc, it handles them well enough
+        static const size_t minPooledSize = 16 * 1024;
+        // max number of free buffers kept per size class
+        static const size_t maxBuffersPerClass = 32;
+
+        static size_t sizeClass(size_t size);
+
+        mutable std::mutex mutex;
+        mutable std::map<size_t, std::vector<uchar*>> freeBuffers;
+        mutable std::vector<UMatData*> freeHeaders;
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
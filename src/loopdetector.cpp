@@ -0,0 +1,191 @@
+#include <opencv2/imgproc.hpp>
+#ifdef DEBUG
+#include <iostream>
+#endif
+#include "loopdetector.h"
+#include "trace.h"
+
+void LoopDetectorParameters::parse(const json11::Json& json)
+{
+    // loop keys are optional, older .json files don't have them
+    auto value = [&](const char* key, double defaultValue)
+    {
+        return json[key].is_number() ? json[key].number_value() : defaultValue;
+    };
+
+    width = value("loopWidth", 6);
+    onRatio = value("loopOnRatio", 0.3);
+    offRatio = value("loopOffRatio", 0.1);
+    hysteresis = value("loopHysteresis", 2);
+    maxGap = value("loopMaxGap", 50);
+}
+
+LoopDetector::LoopDetector(const Size& size, const std::vector<Point>& points,
+        const std::string& directionStr, const json11::Json& json) :
+    frameSize(size)
+{
+    params.parse(json);
+
+    loops[0].pt1 = points[0];
+    loops[0].pt2 = points[1];
+    loops[1].pt1 = points[2];
+    loops[1].pt2 = points[3];
+
+    for (auto& loop: loops)
+        rasterize(loop);
+
+    naturalDirection = Direction(directionStr);
+    oppositeDirection = !naturalDirection;
+}
+
+void LoopDetector::setParameters(const LoopDetectorParameters& parameters)
+{
+    int oldWidth = params.width;
+    params = parameters;
+
+    if (params.width != oldWidth)
+        for (auto& loop: loops)
+            rasterize(loop);
+}
+
+void LoopDetector::rasterize(Loop& loop)
+{
+    // draw counting line as a thick line and store it as horizontal runs,
+    // so that counting foreground pixels is just a couple of linear scans per frame
+    Mat loopMask = Mat::zeros(frameSize, CV_8U);
+    line(loopMask, loop.pt1, loop.pt2, Scalar(1), std::max(params.width, 1), LINE_8);
+
+    loop.spans.clear();
+    loop.area = 0;
+    for (int r = 0; r < loopMask.rows; r++)
+    {
+        const uint8_t* ptr = loopMask.ptr<uint8_t>(r);
+        int c = 0;
+        while (c < loopMask.cols)
+        {
+            if (ptr[c] == 0) { c++; continue; }
+
+            int start = c;
+            while (c < loopMask.cols && ptr[c] != 0) c++;
+            loop.spans.push_back({ r, start, c });
+            loop.area += c - start;
+        }
+    }
+}
+
+int LoopDetector::countForeground(const Mat& fgMask, const Loop& loop) const
+{
+    int count = 0;
+    for (const Span& span: loop.spans)
+    {
+        const uint8_t* ptr = fgMask.ptr<uint8_t>(span.row);
+        for (int c = span.colStart; c < span.colEnd; c++)
+            count += ptr[c] != 0;
+    }
+
+    return count;
+}
+
+void LoopDetector::processFrame(InputArray _fgMask)
+{
+    TIM_TRACE_SCOPE("counting");
+    Mat fgMask = _fgMask.getMat();
+    crossings.clear();
+
+    for (int idx = 0; idx < 2; idx++)
+    {
+        Loop& loop = loops[idx];
+        if (loop.area == 0)
+            continue;
+
+        // forget activations that never got paired
+        if (loop.pendingSince >= 0 && frameCounter - loop.pendingSince > params.maxGap)
+            loop.pendingSince = -1;
+
+        float ratio = countForeground(fgMask, loop) / float(loop.area);
+
+        // occupied/free state machine with hysteresis
+        if (!loop.occupied)
+        {
+            loop.framesAbove = ratio > params.onRatio ? loop.framesAbove + 1 : 0;
+            if (loop.framesAbove >= params.hysteresis)
+            {
+                loop.occupied = true;
+                loop.framesBelow = 0;
+                loopActivated(idx);
+            }
+        }
+        else
+        {
+            loop.framesBelow = ratio < params.offRatio ? loop.framesBelow + 1 : 0;
+            if (loop.framesBelow >= params.hysteresis)
+            {
+                loop.occupied = false;
+                loop.framesAbove = 0;
+            }
+        }
+    }
+
+    frameCounter++;
+}
+
+void LoopDetector::loopActivated(int loopIdx)
+{
+    Loop& other = loops[1 - loopIdx];
+
+    if (other.pendingSince >= 0)
+    {
+        // paired loop fired first, so direction is given by order of activations
+        if (loopIdx == 1)
+            naturalDirection++;
+        else
+            oppositeDirection++;
+
+        // bounding box of the loop that completed the crossing
+        Rect boundingBox(loops[loopIdx].pt1, loops[loopIdx].pt2);
+        crossings.push_back({ crossingCounter++, loopIdx == 1, boundingBox, -1 });
+
+        other.pendingSince = -1;
+        loops[loopIdx].pendingSince = -1;
+#ifdef DEBUG
+        std::cout << "loop " << 1 - loopIdx << " -> loop " << loopIdx << " counted" << std::endl;
+#endif
+    }
+    else
+        loops[loopIdx].pendingSince = frameCounter;
+}
+
+void LoopDetector::drawLoops(InputOutputArray _frame)
+{
+    Mat frame = _frame.getMat();
+
+    for (auto& loop: loops)
+    {
+        Scalar loopColour = loop.occupied ? Scalar(19,38,242) : Scalar(197,247,200);
+        line(frame, loop.pt1, loop.pt2, loopColour, std::max(params.width, 1), LINE_AA);
+    }
+}
+
+void LoopDetector::drawCounters(InputOutputArray _frame)
+{
+    Mat frame = _frame.getMat();
+
+    int fontFace = FONT_HERSHEY_SIMPLEX;
+    double fontScale = 1.0;
+    int thickness = 1;
+
+    int baseline = 0;
+    std::string text = naturalDirection.prettyString();
+    Size textSize = getTextSize(text, fontFace,
+            fontScale, thickness, &baseline);
+
+    Point offset = Point(10, frame.size().height - 10);
+    putText(frame, text, offset, fontFace, fontScale, Scalar::all(255),
+            thickness, LINE_AA, false);
+
+    offset.y -= textSize.height + 5;
+    putText(frame, oppositeDirection.prettyString(), offset, fontFace, fontScale, Scalar::all(255),
+            thickness, LINE_AA, false);
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
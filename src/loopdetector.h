@@ -0,0 +1,77 @@
+#ifndef LOOPDETECTOR_H
+#define LOOPDETECTOR_H
+
+#include <opencv2/core.hpp>
+#include "crossingevents.h"
+#include "direction.h"
+#include "json11.hpp"
+
+using namespace cv;
+
+struct LoopDetectorParameters
+{
+    // loopOnRatio/loopOffRatio: fraction of loop pixels that has to be foreground
+    // for a loop to become occupied/free. loopHysteresis: number of consecutive frames
+    // the ratio has to stay above/below threshold. loopMaxGap: max number of frames
+    // between activations of paired loops.
+    float onRatio, offRatio;
+    int width, hysteresis, maxGap;
+
+    void parse(const json11::Json& json);
+};
+
+class LoopDetector
+{
+    public:
+        LoopDetector(const Size& frameSize, const std::vector<Point>& collisionLines,
+                const std::string& directionStr, const json11::Json& json);
+        // parameters are only replaced between frames
+        void setParameters(const LoopDetectorParameters& parameters);
+
+        void processFrame(InputArray _fgMask);
+
+        void drawLoops(InputOutputArray _frame);
+        void drawCounters(InputOutputArray _frame);
+
+        uint32_t naturalCount() const { return naturalDirection.count(); }
+        uint32_t oppositeCount() const { return oppositeDirection.count(); }
+        // crossings counted by the last processFrame() call, loops don't track objects so IDs are sequential
+        const std::vector<Crossing>& lastCrossings() const { return crossings; }
+
+    private:
+        // horizontal run of loop pixels, [colStart, colEnd)
+        struct Span
+        {
+            int row, colStart, colEnd;
+        };
+
+        struct Loop
+        {
+            Point pt1, pt2;
+            std::vector<Span> spans;
+            int area = 0;
+
+            bool occupied = false;
+            int framesAbove = 0, framesBelow = 0;
+            // frame number of activation still waiting for the paired loop, -1 if none
+            int pendingSince = -1;
+        };
+
+        LoopDetectorParameters params;
+        Size frameSize;
+        int frameCounter = 0;
+        uint32_t crossingCounter = 0;
+        std::vector<Crossing> crossings;
+
+        Loop loops[2];
+        // naturalDirection goes from loop #0 to loop #1
+        Direction naturalDirection, oppositeDirection;
+
+        void rasterize(Loop& loop);
+        int countForeground(const Mat& fgMask, const Loop& loop) const;
+        void loopActivated(int loopIdx);
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
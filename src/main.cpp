@@ -8,8 +8,23 @@ int main(int argc, char** argv)
         "{help h usage ? |      | print this message              }"
         "{@file          |<none>| input file                      }"
         "{b benchmark    |      | benchmark mode                  }"
+        "{bf frames      | 400  | number of measured frames in benchmark mode }"
+        "{bw warmup      | 0    | number of frames processed before benchmark starts measuring }"
+        "{bt benchtrack  |      | include tracking and counting in benchmark mode }"
+        "{bj report      |      | write JSON benchmark report to this file }"
         "{r record       |      | record output                   }"
+        "{ra annotated   |      | record only annotated frame instead of 2x2 view }"
+        "{rb recordblock |      | slow down processing instead of dropping frames when recording }"
+        "{rm recordmasks |      | append foreground masks to foreground.masks }"
+        "{rf recordframes|      | store also background and frame with recorded masks }"
+        "{replay         |      | replay foreground.masks instead of background substraction }"
+        "{syn synthetic  |      | generate synthetic traffic instead of reading video: WIDTHxHEIGHT,OBJECTS,FRAMES[,SEED] }"
+        "{m metrics      |      | publish metrics (Prometheus text format) on ipc:///tmp/tim-metrics.ipc }"
+        "{ev events      | -1   | publish crossing events on ipc:///tmp/tim-events.ipc, with given stream ID }"
+        "{log            |      | append crossings and counts to memory-mapped log BASENAME.NNNNNN.tlog, see tim_log }"
+        "{rt realtime    |      | process at video frame rate, skip shadow removal, colour classification or whole frames when falling behind }"
         "{dnt            |      | don't track moving objects      }"
+        "{l loops        |      | count with virtual loop detectors instead of tracking }"
         "{cc colours     |      | classify colours of passing objects"
         " (more experimental and broken than anything else in this application) }";
 
@@ -26,9 +41,24 @@ int main(int argc, char** argv)
     {
         .fileName = parser.get<String>(0), 
         .benchmark = parser.has("b"),
+        .benchmarkFrames = parser.get<int>("bf"),
+        .benchmarkWarmup = parser.get<int>("bw"),
+        .benchmarkTracking = parser.has("bt"),
+        .benchmarkReport = parser.get<String>("bj"),
+        .synthetic = parser.get<String>("syn"),
+        .metrics = parser.has("m"),
+        .eventStream = parser.get<int>("ev"),
+        .eventLog = parser.get<String>("log"),
+        .realtime = parser.has("rt"),
         .record = parser.has("r"),
+        .recordAnnotatedOnly = parser.has("ra"),
+        .recordBlock = parser.has("rb"),
+        .recordMasks = parser.has("rm"),
+        .recordFrames = parser.has("rf"),
+        .replay = parser.has("replay"),
         .classifyColours = parser.has("cc"),
         .dontTrack = parser.has("dnt"),
+        .loopCounting = parser.has("l"),
     };
 
     if (!parser.check())
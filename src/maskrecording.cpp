@@ -0,0 +1,340 @@
+#include <cstring>
+#include "maskrecording.h"
+#include "trace.h"
+
+namespace MaskRecording
+{
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static bool getVarint(const uint8_t*& ptr, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; ptr < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *ptr++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+void encode(InputArray _mask, std::vector<uint8_t>& encoded)
+{
+    Mat mask = _mask.getMat();
+    CV_Assert(mask.type() == CV_8U);
+
+    encoded.clear();
+    bool foreground = false;
+    uint64_t run = 0;
+
+    // runs continue across rows. most of the mask is background,
+    // so zero runs are skipped 8 pixels at a time.
+    for (int r = 0; r < mask.rows; r++)
+    {
+        const uint8_t* ptr = mask.ptr<uint8_t>(r);
+        int c = 0;
+        while (c < mask.cols)
+        {
+            if (!foreground)
+            {
+                while (c + 8 <= mask.cols)
+                {
+                    uint64_t word;
+                    memcpy(&word, ptr + c, sizeof(word));
+                    if (word != 0)
+                        break;
+                    c += 8;
+                    run += 8;
+                }
+                while (c < mask.cols && ptr[c] == 0)
+                {
+                    c++;
+                    run++;
+                }
+            }
+            else
+            {
+                while (c < mask.cols && ptr[c] != 0)
+                {
+                    c++;
+                    run++;
+                }
+            }
+
+            if (c < mask.cols)
+            {
+                putVarint(encoded, run);
+                run = 0;
+                foreground = !foreground;
+            }
+        }
+    }
+
+    putVarint(encoded, run);
+}
+
+bool decode(const uint8_t* data, size_t size, OutputArray _mask, const Size& frameSize)
+{
+    _mask.create(frameSize, CV_8U);
+    Mat mask = _mask.getMat();
+    CV_Assert(mask.isContinuous());
+
+    uint8_t* out = mask.ptr<uint8_t>();
+    const uint64_t total = uint64_t(mask.total());
+    const uint8_t* ptr = data, *end = data + size;
+    uint64_t pos = 0;
+    bool foreground = false;
+
+    while (ptr < end)
+    {
+        uint64_t run;
+        if (!getVarint(ptr, end, run) || run > total - pos)
+            return false;
+
+        memset(out + pos, foreground ? 1 : 0, run);
+        pos += run;
+        foreground = !foreground;
+    }
+
+    return pos == total;
+}
+
+size_t planesSize(uint32_t planes, const Size& frameSize)
+{
+    size_t pixels = size_t(frameSize.area()), size = 0;
+    if (planes & BACKGROUND)
+        size += pixels * 3;
+    if (planes & STDDEV)
+        size += pixels * sizeof(float);
+    if (planes & FRAME)
+        size += pixels * 3;
+
+    return size;
+}
+
+}
+
+using namespace MaskRecording;
+
+bool MaskWriter::open(const std::string& fileName, const Size& size)
+{
+    frameSize = size;
+
+    // check if there's a recording to append to
+    bool append = false;
+    {
+        std::ifstream existing(fileName, std::ios::binary);
+        FileHeader header;
+        if (existing.read((char*)&header, sizeof(header)))
+        {
+            if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version ||
+                    int(header.width) != size.width || int(header.height) != size.height)
+                return false;
+            append = true;
+        }
+    }
+
+    auto mode = std::ios::binary | (append ? std::ios::app : std::ios::trunc);
+    file.open(fileName, mode);
+    indexFile.open(fileName + ".idx", mode);
+    if (!file.is_open() || !indexFile.is_open())
+    {
+        file.close();
+        indexFile.close();
+        return false;
+    }
+
+    if (!append)
+    {
+        FileHeader header;
+        memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.width = size.width;
+        header.height = size.height;
+        file.write((const char*)&header, sizeof(header));
+    }
+
+    return true;
+}
+
+void MaskWriter::write(InputArray _mask, uint32_t frameIndex, double timestamp, InputArray _bg,
+        InputArray _bgStdDev, InputArray _frame)
+{
+    TIM_TRACE_SCOPE("maskWriter.write");
+    encode(_mask, encoded);
+
+    FrameHeader header = {};
+    header.frameIndex = frameIndex;
+    header.planes = MASK;
+    if (!_bg.empty())
+        header.planes |= BACKGROUND;
+    if (!_bgStdDev.empty())
+        header.planes |= STDDEV;
+    if (!_frame.empty())
+        header.planes |= FRAME;
+    header.timestamp = timestamp;
+    header.maskSize = encoded.size();
+
+    IndexEntry entry = {};
+    entry.frameIndex = frameIndex;
+    entry.planes = header.planes;
+    entry.timestamp = timestamp;
+    entry.offset = file.tellp();
+
+    // index entry is written after the record, so it never points to an incomplete one
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)encoded.data(), encoded.size());
+    if (header.planes & BACKGROUND)
+        writePlane(_bg, CV_8UC3);
+    if (header.planes & STDDEV)
+        writePlane(_bgStdDev, CV_32F);
+    if (header.planes & FRAME)
+        writePlane(_frame, CV_8UC3);
+    file.flush();
+    indexFile.write((const char*)&entry, sizeof(entry));
+}
+
+void MaskWriter::writePlane(InputArray _plane, int type)
+{
+    Mat plane = _plane.getMat();
+    CV_Assert(plane.type() == type && plane.size() == frameSize);
+
+    for (int r = 0; r < plane.rows; r++)
+        file.write((const char*)plane.ptr(r), plane.cols * plane.elemSize());
+}
+
+bool MaskReader::open(const std::string& fileName)
+{
+    file.open(fileName, std::ios::binary);
+    FileHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, magic, sizeof(magic)) != 0 
+            || header.version != version)
+        return false;
+
+    size = Size(header.width, header.height);
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = file.tellg();
+
+    index.clear();
+    std::ifstream indexFile(fileName + ".idx", std::ios::binary);
+    IndexEntry entry;
+    while (indexFile.read((char*)&entry, sizeof(entry)))
+    {
+        if (entry.offset + sizeof(FrameHeader) > fileSize)
+            break;
+        index.push_back(entry);
+    }
+
+    // index is missing or it's behind data file (e.g. recording was interrupted)
+    rebuildIndex(fileSize);
+
+    return true;
+}
+
+void MaskReader::rebuildIndex(uint64_t fileSize)
+{
+    uint64_t offset = sizeof(FileHeader);
+    if (!index.empty())
+    {
+        file.clear();
+        file.seekg(index.back().offset);
+        FrameHeader header;
+        if (!file.read((char*)&header, sizeof(header)))
+            return;
+        offset = index.back().offset + sizeof(header) + header.maskSize + planesSize(header.planes, size);
+    }
+
+    while (offset + sizeof(FrameHeader) <= fileSize)
+    {
+        file.clear();
+        file.seekg(offset);
+        FrameHeader header;
+        if (!file.read((char*)&header, sizeof(header)))
+            break;
+
+        uint64_t recordSize = sizeof(header) + header.maskSize + planesSize(header.planes, size);
+        if (offset + recordSize > fileSize)
+            break;
+
+        IndexEntry entry = {};
+        entry.frameIndex = header.frameIndex;
+        entry.planes = header.planes;
+        entry.timestamp = header.timestamp;
+        entry.offset = offset;
+        index.push_back(entry);
+
+        offset += recordSize;
+    }
+}
+
+bool MaskReader::read(size_t position, OutputArray _mask, OutputArray _bg, OutputArray _bgStdDev, 
+        OutputArray _frame)
+{
+    if (position >= index.size())
+        return false;
+
+    file.clear();
+    file.seekg(index[position].offset);
+    FrameHeader header;
+    if (!file.read((char*)&header, sizeof(header)))
+        return false;
+
+    encoded.resize(header.maskSize);
+    if (!file.read((char*)encoded.data(), encoded.size()))
+        return false;
+
+    if (!decode(encoded.data(), encoded.size(), _mask, size))
+        return false;
+
+    // planes are stored in a fixed order, the ones that aren't needed are skipped
+    struct { uint32_t plane; int type; OutputArray out; } planes[] = 
+    {
+        { BACKGROUND, CV_8UC3, _bg },
+        { STDDEV, CV_32F, _bgStdDev },
+        { FRAME, CV_8UC3, _frame }
+    };
+
+    for (auto& plane: planes)
+    {
+        if (!(header.planes & plane.plane))
+            continue;
+
+        bool ok = plane.out.needed() ? readPlane(plane.out, plane.type) : skipPlane(plane.type);
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+bool MaskReader::readPlane(OutputArray _plane, int type)
+{
+    _plane.create(size, type);
+    Mat plane = _plane.getMat();
+
+    for (int r = 0; r < plane.rows; r++)
+        if (!file.read((char*)plane.ptr(r), plane.cols * plane.elemSize()))
+            return false;
+
+    return true;
+}
+
+bool MaskReader::skipPlane(int type)
+{
+    file.seekg(size.area() * CV_ELEM_SIZE(type), std::ios::cur);
+    return bool(file);
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
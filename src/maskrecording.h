@@ -0,0 +1,112 @@
+#ifndef MASKRECORDING_H
+#define MASKRECORDING_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+// binary recording of foreground masks. data file starts with MaskFileHeader and
+// continues with frame records: MaskFrameHeader followed by run-length encoded mask.
+// mask is stored in row-major order as alternating lengths of background and
+// foreground runs (starting with background), each one encoded as LEB128 varint.
+// optionally, raw background, its standard deviation and the frame follow (in this order),
+// so that all stages after background substraction can be replayed.
+// every frame record has an entry in index file (<fileName>.idx), so that any frame
+// can be read without scanning. both files are only appended to.
+namespace MaskRecording
+{
+    const char magic[4] = { 'T', 'I', 'M', 'M' };
+    const uint32_t version = 1;
+
+    // planes stored in a frame record, mask is always there
+    enum Planes : uint32_t
+    {
+        MASK = 1,
+        BACKGROUND = 2,     // CV_8UC3
+        STDDEV = 4,         // CV_32F
+        FRAME = 8           // CV_8UC3
+    };
+
+    // size of raw planes that follow the mask
+    size_t planesSize(uint32_t planes, const Size& frameSize);
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t width, height;
+    };
+
+    struct FrameHeader
+    {
+        uint32_t frameIndex;
+        uint32_t planes;
+        double timestamp;
+        uint32_t maskSize;
+        uint32_t reserved;
+    };
+
+    struct IndexEntry
+    {
+        uint32_t frameIndex;
+        uint32_t planes;
+        double timestamp;
+        uint64_t offset;
+    };
+
+    void encode(InputArray _mask, std::vector<uint8_t>& encoded);
+    // decoded mask has 1 for foreground and 0 for background
+    bool decode(const uint8_t* data, size_t size, OutputArray _mask, const Size& frameSize);
+}
+
+class MaskWriter
+{
+    public:
+        // appends to existing recording if it has the same frame size
+        bool open(const std::string& fileName, const Size& frameSize);
+        bool isOpened() const { return file.is_open(); }
+
+        // background, its standard deviation and frame are stored only if they are not empty
+        void write(InputArray _mask, uint32_t frameIndex, double timestamp, InputArray _bg = noArray(),
+                InputArray _bgStdDev = noArray(), InputArray _frame = noArray());
+
+    private:
+        std::ofstream file, indexFile;
+        Size frameSize;
+        std::vector<uint8_t> encoded;
+
+        void writePlane(InputArray _plane, int type);
+};
+
+class MaskReader
+{
+    public:
+        bool open(const std::string& fileName);
+
+        Size frameSize() const { return size; }
+        size_t frameCount() const { return index.size(); }
+        const MaskRecording::IndexEntry& entry(size_t position) const { return index[position]; }
+
+        // reads frame at given position in recording (not its frame index).
+        // planes that weren't recorded for this frame are left untouched.
+        bool read(size_t position, OutputArray _mask, OutputArray _bg = noArray(),
+                OutputArray _bgStdDev = noArray(), OutputArray _frame = noArray());
+
+    private:
+        std::ifstream file;
+        Size size;
+        std::vector<MaskRecording::IndexEntry> index;
+        std::vector<uint8_t> encoded;
+
+        void rebuildIndex(uint64_t fileSize);
+        bool readPlane(OutputArray _plane, int type);
+        bool skipPlane(int type);
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,148 @@
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+#include <chrono>
+#include <sstream>
+#include "metrics.h"
+
+const double Histogram::bounds[Histogram::nBuckets - 1] = 
+{
+    0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000
+};
+
+void Histogram::observe(double ms)
+{
+    int bucket = 0;
+    while (bucket < nBuckets - 1 && ms > bounds[bucket])
+        bucket++;
+
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumMicroseconds.fetch_add(uint64_t(ms * 1000), std::memory_order_relaxed);
+}
+
+std::string Histogram::prometheusText(const std::string& name, const std::string& labels) const
+{
+    // buckets are read one by one, so a scrape can be off by the frames processed meanwhile
+    std::ostringstream text;
+    std::string separator = labels.empty() ? "" : ",";
+
+    uint64_t cumulative = 0;
+    for (int bucket = 0; bucket < nBuckets; bucket++)
+    {
+        cumulative += counts[bucket].load(std::memory_order_relaxed);
+        text << name << "_bucket{" << labels << separator << "le=\"";
+        if (bucket < nBuckets - 1)
+            text << bounds[bucket] / 1000;
+        else
+            text << "+Inf";
+        text << "\"} " << cumulative << "\n";
+    }
+
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    text << name << "_sum" << braces << " " << sumMicroseconds.load(std::memory_order_relaxed) / 1e6 << "\n";
+    text << name << "_count" << braces << " " << count.load(std::memory_order_relaxed) << "\n";
+
+    return text.str();
+}
+
+void Metrics::observeFrame(const StageTimer& timer)
+{
+    framesProcessed.fetch_add(1, std::memory_order_relaxed);
+
+    for (int stage = 0; stage < StageTimer::STAGES_NUM; stage++)
+    {
+        // stages that didn't run in this frame are left out
+        double ms = timer.lastStageTime(StageTimer::Stage(stage));
+        if (ms > 0)
+            stageLatency[stage].observe(ms);
+    }
+    frameLatency.observe(timer.lastFrameTime());
+}
+
+std::string Metrics::prometheusText(double fps) const
+{
+    std::ostringstream text;
+
+    text << "# TYPE tim_fps gauge\n"
+         << "tim_fps " << fps << "\n"
+         << "# TYPE tim_frames_processed_total counter\n"
+         << "tim_frames_processed_total " << framesProcessed.load(std::memory_order_relaxed) << "\n"
+         << "# TYPE tim_skipped_frames_total counter\n"
+         << "tim_skipped_frames_total " << framesSkipped.load(std::memory_order_relaxed) << "\n"
+         << "# TYPE tim_degraded_frames_total counter\n"
+         << "tim_degraded_frames_total " << framesDegraded.load(std::memory_order_relaxed) << "\n"
+         << "# TYPE tim_recorder_dropped_frames_total counter\n"
+         << "tim_recorder_dropped_frames_total " << recorderDroppedFrames.load(std::memory_order_relaxed) << "\n"
+         << "# TYPE tim_active_tracks gauge\n"
+         << "tim_active_tracks " << activeTracks.load(std::memory_order_relaxed) << "\n"
+         << "# TYPE tim_crossings_total counter\n"
+         << "tim_crossings_total{direction=\"natural\"} " << naturalCount.load(std::memory_order_relaxed) << "\n"
+         << "tim_crossings_total{direction=\"opposite\"} " << oppositeCount.load(std::memory_order_relaxed) << "\n";
+
+    // latencies in seconds, as Prometheus conventions say
+    text << "# TYPE tim_stage_latency_seconds histogram\n";
+    for (int stage = 0; stage < StageTimer::STAGES_NUM; stage++)
+    {
+        std::string labels = std::string("stage=\"") + StageTimer::stageName(StageTimer::Stage(stage)) + "\"";
+        text << stageLatency[stage].prometheusText("tim_stage_latency_seconds", labels);
+    }
+
+    text << "# TYPE tim_frame_latency_seconds histogram\n"
+         << frameLatency.prometheusText("tim_frame_latency_seconds", "");
+
+    return text.str();
+}
+
+MetricsPublisher::MetricsPublisher(const Metrics& metrics, const std::string& address, int intervalMs) :
+    metrics(metrics), intervalMs(intervalMs)
+{
+    socket = nn_socket(AF_SP, NN_PUB);
+    if (socket < 0)
+        return;
+
+    if (nn_bind(socket, address.c_str()) < 0)
+    {
+        nn_close(socket);
+        socket = -1;
+        return;
+    }
+
+    thread = std::thread(&MetricsPublisher::run, this);
+}
+
+MetricsPublisher::~MetricsPublisher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stopped.notify_one();
+
+    if (thread.joinable())
+        thread.join();
+    if (socket >= 0)
+        nn_close(socket);
+}
+
+void MetricsPublisher::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point lastTime = Clock::now();
+    uint64_t lastFrames = metrics.framesProcessed.load(std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped.wait_for(lock, std::chrono::milliseconds(intervalMs), [&] { return stopping; }))
+    {
+        Clock::time_point now = Clock::now();
+        uint64_t frames = metrics.framesProcessed.load(std::memory_order_relaxed);
+        double fps = (frames - lastFrames) / std::chrono::duration<double>(now - lastTime).count();
+        lastTime = now;
+        lastFrames = frames;
+
+        // PUB socket never blocks, subscribers that can't keep up lose messages
+        std::string text = metrics.prometheusText(fps);
+        nn_send(socket, text.data(), text.size(), NN_DONTWAIT);
+    }
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
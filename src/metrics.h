@@ -0,0 +1,71 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "stagetimer.h"
+
+// histogram with fixed buckets, safe to update from any thread without locks
+class Histogram
+{
+    public:
+        static const int nBuckets = 14;
+        // upper bounds of buckets in milliseconds, the last one is +Inf
+        static const double bounds[nBuckets - 1];
+
+        void observe(double ms);
+        // Prometheus text format, cumulative buckets
+        std::string prometheusText(const std::string& name, const std::string& labels) const;
+
+    private:
+        std::atomic<uint64_t> counts[nBuckets] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sumMicroseconds{0};
+};
+
+// counters and gauges updated by processing thread, read by publisher.
+// all updates are relaxed atomic operations.
+struct Metrics
+{
+    std::atomic<uint64_t> framesProcessed{0}, recorderDroppedFrames{0};
+    // real-time mode only
+    std::atomic<uint64_t> framesSkipped{0}, framesDegraded{0};
+    std::atomic<uint64_t> activeTracks{0}, naturalCount{0}, oppositeCount{0};
+    Histogram stageLatency[StageTimer::STAGES_NUM], frameLatency;
+
+    // stage times of the last frame measured by 'timer'
+    void observeFrame(const StageTimer& timer);
+
+    // fps is measured by the caller over its publishing interval
+    std::string prometheusText(double fps) const;
+};
+
+// publishes metrics in Prometheus text format on a nanomsg PUB socket, from its own thread
+class MetricsPublisher
+{
+    public:
+        MetricsPublisher(const Metrics& metrics, const std::string& address, int intervalMs = 1000);
+        ~MetricsPublisher();
+
+        bool isOpened() const { return socket >= 0; }
+
+    private:
+        const Metrics& metrics;
+        int socket;
+        int intervalMs;
+
+        bool stopping = false;
+        std::mutex mutex;
+        std::condition_variable stopped;
+        std::thread thread;
+
+        void run();
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
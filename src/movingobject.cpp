@@ -5,16 +5,11 @@
 #endif
 #include "movingobject.h"
 
-Segment::Segment(Mat& mask, int area) : 
-    mask(mask), area(area) 
+Segment::Segment(int area) : 
+    area(area) 
 { 
 }
 
-Segment::Segment(const Segment& other) : 
-    mask(other.mask.clone()), area(other.area)
-{
-}
-
 MovingObject::MovingObject(const Size& size) :
     maxNumberOfFeatures(10),
     featureQualityLevel(0.01),
@@ -8,11 +8,13 @@ using namespace cv;
 
 struct Segment
 {
-    Segment(Mat& mask, int area);
-    Segment(const Segment& other);
+    Segment(int area);
 
-    Mat mask;
     int area;
+
+    // accumulated by Shadows::segmentStatistics
+    double ratioSum[3] = { 0, 0, 0 };
+    int nTerminal = 0, nExternal = 0;
 };
 
 class MovingObject
@@ -0,0 +1,144 @@
+#include "perfcounters.h"
+#ifdef PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#endif
+
+PerfSample PerfSample::operator-(const PerfSample& other) const
+{
+    // scaling totals separately and subtracting them afterwards could give negative
+    // (wrapped) counts when the ratio changes, so differences are scaled instead
+    uint64_t enabled = timeEnabled - other.timeEnabled;
+    uint64_t running = timeRunning - other.timeRunning;
+    double scale = running > 0 ? double(enabled) / running : 1.0;
+
+    PerfSample result;
+    result.cycles = (cycles - other.cycles) * scale;
+    result.instructions = (instructions - other.instructions) * scale;
+    result.llcMisses = (llcMisses - other.llcMisses) * scale;
+    result.branchMisses = (branchMisses - other.branchMisses) * scale;
+    result.timeEnabled = result.timeRunning = enabled;
+    return result;
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other)
+{
+    cycles += other.cycles;
+    instructions += other.instructions;
+    llcMisses += other.llcMisses;
+    branchMisses += other.branchMisses;
+    timeEnabled += other.timeEnabled;
+    timeRunning += other.timeRunning;
+    return *this;
+}
+
+#ifdef PERF_COUNTERS
+
+PerfCounters::PerfCounters()
+{
+    const uint64_t events[nEvents] = 
+    {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, 
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // group leader starts disabled, other events follow it
+        attr.disabled = i == 0;
+
+        // this thread, any CPU
+        fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+        if (fds[i] < 0)
+        {
+            static bool reported = false;
+            if (!reported)
+                std::cout << "hardware performance counters are not available (check "
+                             "/proc/sys/kernel/perf_event_paranoid)" << std::endl;
+            reported = true;
+
+            for (int j = 0; j < i; j++)
+                close(fds[j]);
+            return;
+        }
+    }
+
+    groupFd = fds[0];
+    ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters()
+{
+    if (groupFd < 0)
+        return;
+
+    for (int fd: fds)
+        close(fd);
+}
+
+PerfCounters& PerfCounters::threadCounters()
+{
+    thread_local PerfCounters counters;
+    return counters;
+}
+
+PerfSample PerfCounters::read() const
+{
+    PerfSample sample;
+    if (groupFd < 0)
+        return sample;
+
+    // nr, time_enabled, time_running, values[nr]
+    uint64_t data[3 + nEvents];
+    if (::read(groupFd, data, sizeof(data)) != sizeof(data))
+        return sample;
+
+    sample.timeEnabled = data[1];
+    sample.timeRunning = data[2];
+    sample.cycles = data[3];
+    sample.instructions = data[4];
+    sample.llcMisses = data[5];
+    sample.branchMisses = data[6];
+
+    return sample;
+}
+
+void PerfAccumulator::add(const PerfSample& sample)
+{
+    cycles += sample.cycles;
+    instructions += sample.instructions;
+    llcMisses += sample.llcMisses;
+    branchMisses += sample.branchMisses;
+}
+
+void PerfAccumulator::reset()
+{
+    cycles = instructions = llcMisses = branchMisses = 0;
+}
+
+PerfSample PerfAccumulator::total() const
+{
+    PerfSample sample;
+    sample.cycles = cycles;
+    sample.instructions = instructions;
+    sample.llcMisses = llcMisses;
+    sample.branchMisses = branchMisses;
+    return sample;
+}
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
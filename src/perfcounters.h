@@ -0,0 +1,58 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+// hardware performance counters (Linux perf_event_open). everything except PerfSample
+// is compiled only with PERF_COUNTERS defined.
+struct PerfSample
+{
+    uint64_t cycles = 0, instructions = 0, llcMisses = 0, branchMisses = 0;
+    // time (ns) the group was enabled and actually counting, they differ when it was multiplexed
+    uint64_t timeEnabled = 0, timeRunning = 0;
+
+    // counts between other and this sample, extrapolated if the group was multiplexed
+    // in between. result is already scaled (its timeRunning equals timeEnabled).
+    PerfSample operator-(const PerfSample& other) const;
+    PerfSample& operator+=(const PerfSample& other);
+};
+
+#ifdef PERF_COUNTERS
+// counters of one thread, opened as a single group so that they're scheduled together
+class PerfCounters
+{
+    public:
+        ~PerfCounters();
+
+        // counters of the calling thread, opened on first use
+        static PerfCounters& threadCounters();
+
+        bool isOpened() const { return groupFd >= 0; }
+        // raw counts since counters were opened, subtract two samples to get scaled counts
+        PerfSample read() const;
+
+    private:
+        static const int nEvents = 4;
+        int groupFd = -1;
+        int fds[nEvents] = { -1, -1, -1, -1 };
+
+        PerfCounters();
+};
+
+// sums samples coming from several threads (e.g. thread pool workers)
+class PerfAccumulator
+{
+    public:
+        void add(const PerfSample& sample);
+        void reset();
+        PerfSample total() const;
+
+    private:
+        std::atomic<uint64_t> cycles{0}, instructions{0}, llcMisses{0}, branchMisses{0};
+};
+#endif
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "realtime.h"
+
+RealtimeScheduler::RealtimeScheduler(double fps, int maxConsecutiveSkips) :
+    fps(fps > 0 ? fps : 25), period(1.0 / this->fps), maxConsecutiveSkips(maxConsecutiveSkips)
+{
+}
+
+double RealtimeScheduler::clock() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RealtimeScheduler::sleep(double seconds)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+double RealtimeScheduler::now() const
+{
+    return clock() - start;
+}
+
+RealtimeScheduler::Decision RealtimeScheduler::beginFrame()
+{
+    if (!started)
+    {
+        start = clock();
+        frameNumber = 0;
+        started = true;
+    }
+
+    double arrival = frameNumber++ * period;
+    double t = now();
+    if (t < arrival)
+    {
+        sleep(arrival - t);
+        t = arrival;
+    }
+
+    // too far behind: frames are only grabbed until processing catches up with the source.
+    // without this, forced degraded frames that take longer than a few periods would make
+    // the lag grow without limit.
+    bool catchingUp = t - arrival > maxLagPeriods * period;
+
+    frameStart = t;
+    deadline = arrival + period;
+
+    // probe tells whether load went down since the last full frame
+    probing = t + fullCost > deadline && framesSinceFull >= int(fps) && t + degradedCost <= deadline;
+
+    Decision decision;
+    if (catchingUp)
+        decision = SKIP;
+    else if (t + fullCost <= deadline || probing)
+        decision = FULL;
+    else if (t + degradedCost <= deadline || consecutiveSkips >= maxConsecutiveSkips)
+        decision = DEGRADED;
+    else
+        decision = SKIP;
+
+    consecutiveSkips = decision == SKIP ? consecutiveSkips + 1 : 0;
+    framesSinceFull = decision == FULL ? 0 : framesSinceFull + 1;
+    scheduled++;
+    if (decision == SKIP)
+        skipped++;
+    else if (decision == DEGRADED)
+        degraded++;
+
+    return decision;
+}
+
+void RealtimeScheduler::endFrame(Decision decision)
+{
+    double t = now();
+    if (t > deadline)
+        deadlinesMissed++;
+
+    // the first measurement and probes replace the average, so that old estimate doesn't linger
+    const double alpha = 0.1;
+    double& cost = decision == FULL ? fullCost : degradedCost;
+    double elapsed = t - frameStart;
+    cost = cost == 0 || (decision == FULL && probing) ? elapsed : (1 - alpha) * cost + alpha * elapsed;
+}
+
+void RealtimeScheduler::printReport() const
+{
+    double frames = std::max<uint64_t>(scheduled, 1);
+    std::cout << std::fixed << std::setprecision(1) << "real-time at " << fps << " fps: " << scheduled 
+              << " frames, " << skipped << " skipped (" << 100 * skipped / frames << " %), " 
+              << degraded << " without optional stages (" << 100 * degraded / frames << " %), " 
+              << deadlinesMissed << " deadlines missed" << std::endl;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,69 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <chrono>
+#include <cstdint>
+
+// paces processing to frame rate of the source, as if it was a live camera, and decides
+// how much of every frame can be processed without falling behind. frame n arrives at
+// start + n/fps and has to be done before the next one arrives. costs of full frames and
+// of frames without optional stages (shadow removal, colour classification) are tracked
+// as moving averages: a frame is processed fully if that fits before its deadline,
+// without optional stages if only that fits, and skipped otherwise. consecutive skips
+// are limited, so that tracked objects don't jump over counting lines, unless processing
+// is more than maxLagPeriods behind the source: then frames are skipped until it catches up,
+// so that latency stays bounded even if degraded frames don't fit either. cost of full frames
+// is only known when they run, so once a second a full frame is tried even when degraded.
+class RealtimeScheduler
+{
+    public:
+        enum Decision
+        {
+            FULL,
+            DEGRADED,
+            SKIP
+        };
+
+        explicit RealtimeScheduler(double fps, int maxConsecutiveSkips = 2);
+        virtual ~RealtimeScheduler() {}
+
+        // waits for arrival of the frame if processing is ahead of the source
+        Decision beginFrame();
+        // called when a frame that wasn't skipped is done
+        void endFrame(Decision decision);
+        // schedule starts again from the next frame (e.g. after pause)
+        void restart() { started = false; }
+
+        uint64_t framesSkipped() const { return skipped; }
+        uint64_t framesDegraded() const { return degraded; }
+        void printReport() const;
+
+    protected:
+        // monotonic time [s] and waiting, virtual so that overload can be simulated in tests
+        virtual double clock() const;
+        virtual void sleep(double seconds);
+
+    private:
+        static const int maxLagPeriods = 3;
+
+        double fps, period;
+        int maxConsecutiveSkips, consecutiveSkips = 0;
+        int framesSinceFull = 0;
+        bool probing = false;
+
+        bool started = false;
+        double start = 0;
+        uint64_t frameNumber = 0;
+        // [s] since start
+        double frameStart = 0, deadline = 0;
+        // moving averages of processing time [s]
+        double fullCost = 0, degradedCost = 0;
+
+        uint64_t scheduled = 0, skipped = 0, degraded = 0, deadlinesMissed = 0;
+
+        double now() const;
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
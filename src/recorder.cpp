@@ -0,0 +1,105 @@
+#include "recorder.h"
+#include "trace.h"
+
+Recorder::Recorder(const std::string& fileName, double fps, const Size& frameSize, bool annotatedOnly,
+        bool blockWhenFull, int queueSize) :
+    size(annotatedOnly ? frameSize : Size(frameSize.width * 2, frameSize.height * 2)),
+    annotatedOnly(annotatedOnly), blockWhenFull(blockWhenFull), slots(std::max(queueSize, 1)),
+    written(0), dropped(0)
+{
+    videoWriter.open(fileName, VideoWriter::fourcc('X','V','I','D'), fps, size);
+    if (videoWriter.isOpened())
+        thread = std::thread(&Recorder::run, this);
+}
+
+Recorder::~Recorder()
+{
+    finish();
+}
+
+void Recorder::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    notEmpty.notify_one();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void Recorder::push(const DisplayViews& views)
+{
+    TIM_TRACE_SCOPE("recorder.push");
+    if (!videoWriter.isOpened())
+        return;
+
+    int slotIdx;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (count == int(slots.size()))
+        {
+            if (!blockWhenFull)
+            {
+                dropped++;
+                return;
+            }
+            notFull.wait(lock, [&] { return count < int(slots.size()); });
+        }
+        slotIdx = (head + count) % slots.size();
+    }
+
+    // buffers of the slot are reused, so after the first round this doesn't allocate
+    DisplayViews& slot = slots[slotIdx];
+    views.frame.copyTo(slot.frame);
+    if (!annotatedOnly)
+    {
+        views.foregroundMask.copyTo(slot.foregroundMask);
+        views.background.copyTo(slot.background);
+        views.shadowMask.copyTo(slot.shadowMask);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        count++;
+    }
+    notEmpty.notify_one();
+}
+
+void Recorder::run()
+{
+    Compositor compositor;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&] { return count > 0 || stopping; });
+            // queued frames are written even when stopping
+            if (count == 0)
+                break;
+        }
+
+        {
+            TIM_TRACE_SCOPE("recorder.encode");
+            const DisplayViews& slot = slots[head];
+            if (annotatedOnly)
+                videoWriter.write(slot.frame);
+            else
+                videoWriter.write(compositor.compose(slot));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            head = (head + 1) % slots.size();
+            count--;
+            written++;
+        }
+        notFull.notify_one();
+    }
+
+    videoWriter.release();
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
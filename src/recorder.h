@@ -0,0 +1,58 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <opencv2/videoio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "display.h"
+
+using namespace cv;
+
+// records processed frames on its own thread. frames are passed through a bounded queue,
+// when encoder falls behind new frames are either dropped or processing waits for a free slot.
+class Recorder
+{
+    public:
+        // annotatedOnly: record just the annotated frame instead of the 2x2 debug view
+        Recorder(const std::string& fileName, double fps, const Size& frameSize, bool annotatedOnly,
+                bool blockWhenFull, int queueSize = 8);
+        ~Recorder();
+
+        // encodes frames that are still queued and closes the file
+        void finish();
+
+        bool isOpened() const { return videoWriter.isOpened(); }
+        // size of recorded video, depends on annotatedOnly
+        Size outputSize() const { return size; }
+
+        void push(const DisplayViews& views);
+
+        uint32_t framesWritten() const { return written; }
+        uint32_t framesDropped() const { return dropped; }
+
+    private:
+        VideoWriter videoWriter;
+        Size size;
+        bool annotatedOnly, blockWhenFull;
+
+        // ring of preallocated slots. only the producer writes to slot at head + count
+        // and only the encoder reads slot at head, so copying and encoding happen outside of the lock.
+        std::vector<DisplayViews> slots;
+        int head = 0, count = 0;
+        bool stopping = false;
+        std::atomic<uint32_t> written, dropped;
+
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull;
+        std::thread thread;
+
+        void run();
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -3,8 +3,43 @@
 #ifdef DEBUG
 #include <iostream>
 #endif
+#include <atomic>
+#include <cstring>
+#ifdef SIMD
+#include <emmintrin.h>
+#endif
 #include "shadows.h"
 #include "background.h"
+#include "trace.h"
+
+#ifdef SIMD
+// converts 4 BGR pixels (12 bytes, 16 bytes are read) to planar floats
+static inline void deinterleaveBGR(const uint8_t* bgr, __m128& B, __m128& G, __m128& R)
+{
+    // same shuffling as in background kernel, SSE2 doesn't have byte shuffles
+    __m128i data = _mm_loadu_si128((const __m128i*)bgr);
+    __m128i tmp1, tmp2, tmp3;
+    tmp1 = _mm_and_si128(data, _mm_setr_epi8(0xFF,0xFF,0xFF,0,0,0,0,0,0,0,0,0,0,0,0,0));
+    tmp2 = _mm_and_si128(data, _mm_setr_epi8(0,0,0,0xFF,0xFF,0xFF,0,0,0,0,0,0,0,0,0,0));
+    tmp3 = _mm_and_si128(data, _mm_setr_epi8(0,0,0,0,0,0,0xFF,0xFF,0xFF,0,0,0,0,0,0,0));
+    tmp2 = _mm_slli_si128(tmp2, 1);
+    tmp3 = _mm_slli_si128(tmp3, 2);
+    tmp1 = _mm_or_si128(tmp1, tmp2);
+    tmp2 = _mm_and_si128(data, _mm_setr_epi8(0,0,0,0,0,0,0,0,0,0xFF,0xFF,0xFF,0,0,0,0));
+    tmp2 = _mm_slli_si128(tmp2, 3);
+    tmp3 = _mm_or_si128(tmp3, tmp2);
+    data = _mm_or_si128(tmp1, tmp3);
+
+    // data: B1G1R10 B2G2R20 B3G3R30 B4G4R40
+    tmp1 = _mm_and_si128(data, _mm_set1_epi32(0x000000FF));
+    tmp2 = _mm_srli_si128(_mm_and_si128(data, _mm_set1_epi32(0x0000FF00)), 1);
+    tmp3 = _mm_srli_si128(_mm_and_si128(data, _mm_set1_epi32(0x00FF0000)), 2);
+
+    B = _mm_cvtepi32_ps(tmp1);
+    G = _mm_cvtepi32_ps(tmp2);
+    R = _mm_cvtepi32_ps(tmp3);
+}
+#endif
 
 void ShadowsParameters::parse(const json11::Json& json)
 {
@@ -18,332 +53,919 @@ void ShadowsParameters::parse(const json11::Json& json)
     gradientThreshold = json["gradientThreshold"].number_value();
     minObjectSize = json["minObjectSize"].int_value();
     minSegmentSize = json["minSegmentSize"].int_value();
-    randomReconstruction = json["randomReconstruction"].bool_value();
+
+    // cache keys are optional, older .json files don't have them
+    auto value = [&](const char* key, double defaultValue)
+    {
+        return json[key].is_number() ? json[key].number_value() : defaultValue;
+    };
+
+    cacheFrames = value("shadowCacheFrames", 0);
+    cacheRatioThreshold = value("shadowCacheRatioThreshold", 0.1);
+    cacheMaxChange = value("shadowCacheMaxChange", 0.2);
+
+    chromaticityEngine = json["shadowEngine"].string_value() == "chromaticity";
+    chromaticityThreshold = value("chromaticityThreshold", 3.0);
+    brightnessLow = value("brightnessLow", 0.4);
+    brightnessHigh = value("brightnessHigh", 1.0);
+
+    // optional as well, objects are processed in parallel unless it's turned off
+    parallelObjects = json["shadowParallelObjects"].is_bool() ? json["shadowParallelObjects"].bool_value() : true;
+}
+
+Shadows::Shadows(const json11::Json& json) :
+    edgeCorrectionKernel(getStructuringElement(MORPH_RECT, Size(5,5)))
+#ifdef MULTITHREADING
+    , nThreads(WorkerPool::size())
+#endif
+{
+#ifdef MULTITHREADING
+    scratch.resize(nThreads);
+#else
+    scratch.resize(1);
+#endif
+
+    params.parse(json);
 }
 
-Shadows::Shadows(const json11::Json& json)
+void Shadows::setParameters(const ShadowsParameters& parameters)
 {
-    updateParameters(json);
+    params = parameters;
 }
 
-void Shadows::updateParameters(const json11::Json& json)
+bool Shadows::needsRatio() const
 {
-    this->params.parse(json);
+    return !params.chromaticityEngine;
 }
 
 void Shadows::removeShadows(InputArray _src, InputArray _bg, InputArray _bgStdDev, InputArray _fgMask, 
-        InputArray _objectLabels, std::vector<MovingObject>& movingObjects, OutputArray _dst)
+        InputArray _objectLabels, std::vector<MovingObject>& movingObjects, OutputArray _dst,
+        InputArray _ratio)
 {
+    TIM_TRACE_SCOPE("shadows");
     Mat frame = _src.getMat(), background = _bg.getMat(), backgroundStdDev = _bgStdDev.getMat(),
         foregroundMask = _fgMask.getMat(), objectLabels = _objectLabels.getMat(), 
-        labelMask = _dst.getMat(), shadowMask = Mat::zeros(frame.size(), CV_8U);
-
-    // calculate D (eq. 7) 
-    D = Mat::zeros(frame.size(), CV_32FC3);
-    Mat tmp = Mat::zeros(frame.size(), CV_32FC3);
-    const double v = 1;
-    background.convertTo(D, CV_32F, 1, v);
-    frame.convertTo(tmp, CV_32F, 1, v);
-    divide(D, tmp, tmp, 1, CV_32FC3);
-    D *= 0;
-    tmp.copyTo(D, foregroundMask);
-    //D *= 0.25;
+        labelMask = _dst.getMat();
+
+    shadowMask.create(frame.size(), CV_8U);
+    shadowMask.setTo(0);
+
+    if (params.chromaticityEngine)
+    {
+        // fast per-pixel classification, no segmentation
+        classifyPixels(frame, background, backgroundStdDev, foregroundMask, shadowMask);
+        subtractShadows(movingObjects, shadowMask);
+        shadowMask.copyTo(_dst);
+        return;
+    }
+
+    // D (eq. 7) is either provided by background substraction or calculated per object,
+    // only inside its bounding box. in the latter case it's stored in full-frame buffer 
+    // that is allocated only once.
+    bool ratioProvided = !_ratio.empty();
+    if (ratioProvided)
+        D = _ratio.getMat();
+    else
+        D.create(frame.size(), CV_32FC3);
+
+    // objects are independent, so each stage below processes them in parallel.
+    // every object writes only to its own pixels, so results don't depend on scheduling.
+    if (params.edgeCorrection)
+    {
+        // erosion only affects pixels within bounding box of an object (plus halo, 
+        // so that erosion kernel sees the same neighbourhood as in the full frame)
+        forEachObject(movingObjects, [&](MovingObject& object, SegmentationScratch&)
+        {
+            Rect halo = haloRect(object.selector, frame.size());
+            erode(object.mask(halo), object.mask(halo), edgeCorrectionKernel);
+            object.minimizeMask();
+        });
+    }
+
+    // bounding boxes may overlap, so D and eroded labels are calculated serially
+    if (!ratioProvided)
+        for (MovingObject& object: movingObjects)
+            computeRatio(frame, background, object.selector);
+
+    if (params.edgeCorrection)
+    {
+        // labels are only needed inside bounding boxes. overlapping boxes have to see
+        // labels before erosion, so eroded labels go to a separate buffer first.
+        erodedLabels.create(objectLabels.size(), objectLabels.type());
+        for (MovingObject& object: movingObjects)
+        {
+            Rect halo = haloRect(object.selector, frame.size());
+            erode(objectLabels(halo), erodedLabels(halo), edgeCorrectionKernel);
+        }
+
+        for (MovingObject& object: movingObjects)
+            erodedLabels(object.selector).copyTo(objectLabels(object.selector));
+    }
+
 #if DEBUG
-    double maxVal, minVal;
-    minMaxLoc(D, &minVal, &maxVal);
-    //std::cout << "D mean: " << cv::mean(D, foregroundMask) << std::endl;
-    //imshow("D", D/maxVal);
+    luminanceCritetion = Mat::zeros(frame.size(), CV_8U);
+    sizeCriterion = Mat::zeros(frame.size(), CV_8U);
+    externalPointsCriterion = Mat::zeros(frame.size(), CV_8U);
 #endif
 
-    // divide each moving objects into sub-segments
-    for (MovingObject& object: movingObjects)
+    // divide each moving object into sub-segments and decide which of them are shadows.
+    // if possible, reuse classification from previous frame instead.
+    // while caching is off, cache is dropped, so that it can't be arbitrarily old once it's turned on again
+    if (params.cacheFrames > 0)
+        newCache.resize(movingObjects.size());
+    else
+    {
+        cache.clear();
+        newCache.clear();
+    }
+
+    forEachObject(movingObjects, [&](MovingObject& object, SegmentationScratch& scratch)
     {
-        if (params.edgeCorrection)
+        CachedClassification* cacheEntry = nullptr;
+        if (params.cacheFrames > 0)
         {
-            erode(object.mask, object.mask, getStructuringElement(MORPH_RECT, Size(5,5)));
-            object.minimizeMask();
+            // entry may still hold classification of another object from an older frame
+            cacheEntry = &newCache[&object - movingObjects.data()];
+            cacheEntry->valid = false;
+            if (reuseClassification(object, shadowMask, *cacheEntry))
+                return;
         }
 
         float grThr = params.gradientThreshold;
         if (params.autoGradientThreshold)
+            grThr = autoGradientThreshold(object, background, backgroundStdDev);
+
+        labelSegments(object, grThr, scratch);
+        classifySegments(object, objectLabels(object.selector), shadowMask, scratch);
+
+        if (cacheEntry)
         {
-            // calculate gradient threshold
-            float objSize = countNonZero(object.miniMask);
-            Mat objBg, objStdDev;
-            background(object.selector).copyTo(objBg, object.miniMask);
-            backgroundStdDev(object.selector).copyTo(objStdDev, object.miniMask);
-
-            Scalar meanSum = cv::sum(objBg);
-            Scalar stdDevSum = cv::sum(objStdDev);
-
-            grThr = params.alpha / objSize;
-            grThr *= meanSum[0] * stdDevSum[0] / objSize; 
-            grThr *= params.gradientThresholdMultiplier;
+            cacheEntry->selector = object.selector;
+            cacheEntry->classes = Mat::zeros(object.selector.size(), CV_8U);
+            shadowMask(object.selector).copyTo(cacheEntry->classes, object.miniMask);
+            D(object.selector).copyTo(cacheEntry->ratio);
+            cacheEntry->age = 0;
+            cacheEntry->valid = true;
+        }
+    });
+    std::swap(cache, newCache);
+
 #if DEBUG
-            std::cout << "ID: " << object.ID << ", threshold: " << grThr << ", obj size: " 
-                      << objSize << std::endl;
+    Mat globalSegmentMap = Mat::zeros(frame.size(), CV_16U);
+    uint32_t globalSegmentCounter = 0;
+    for (MovingObject& object: movingObjects)
+    {
+        // objects with reused classification aren't segmented
+        if (object.segmentLabels.empty())
+            continue;
+
+        globalSegmentMap(object.selector) += object.segmentLabels;
+        globalSegmentCounter += object.segments.size();
+    }
+
+    imshow("luminanceCritetion", 255*luminanceCritetion);
+    imshow("sizeCriterion", 255*sizeCriterion);
+    imshow("externalPointsCriterion", 255*externalPointsCriterion);
+    
+    if(globalSegmentCounter != 0)
+        showSegmentation(globalSegmentCounter, globalSegmentMap);
+
+    imshow("shadowMask w/ blanks", (255/2)*shadowMask);
 #endif
-        }
 
-        Mat segmentLabels = Mat::zeros(object.miniMask.size(), CV_16U);
-        int currentLabel = 0;
-        
-        for (int r = 0; r < object.miniMask.rows; r++)
+    fillInBlanks(foregroundMask, shadowMask);
+    //showSegmentation(nLabels, objectLabels);
+    
+    subtractShadows(movingObjects, shadowMask);
+    shadowMask.copyTo(_dst);
+}
+
+void Shadows::subtractShadows(std::vector<MovingObject>& movingObjects, InputArray _shadowMask)
+{
+    TIM_TRACE_SCOPE("shadows.subtract");
+    compare(_shadowMask, 1, onlyShadows, CMP_EQ);
+    forEachObject(movingObjects, [&](MovingObject& obj, SegmentationScratch&)
+    {
+        obj.mask -= onlyShadows;
+        obj.minimizeMask();
+    });
+}
+
+void Shadows::classifyPixels(InputArray _src, InputArray _bg, InputArray _bgStdDev, InputArray _fgMask,
+        InputOutputArray _dst)
+{
+    TIM_TRACE_SCOPE("shadows.classifyPixels");
+    // brightness and chromaticity distortion (Horprasert et al.). background model has
+    // one standard deviation for all channels, so for frame pixel I and background pixel E:
+    //   brightness distortion   alpha = (I.E) / (E.E)
+    //   chromaticity distortion CD    = |I - alpha*E| / stdDev
+    // foreground pixel is a shadow if it's darker than background (alpha within 
+    // [brightnessLow, brightnessHigh)) and its colour is close to background (CD < chromaticityThreshold).
+    Mat frame = _src.getMat(), background = _bg.getMat(), backgroundStdDev = _bgStdDev.getMat(),
+        foregroundMask = _fgMask.getMat(), shadowMask = _dst.getMat();
+    const int cols = frame.cols;
+    const float tauCD = params.chromaticityThreshold, alphaLow = params.brightnessLow, 
+                alphaHigh = params.brightnessHigh;
+
+    auto classifyPixel = [&](const uint8_t* I, const uint8_t* E, float stdDev) -> uint8_t
+    {
+        float dotIE = I[0]*E[0] + I[1]*E[1] + I[2]*E[2];
+        float dotEE = E[0]*E[0] + E[1]*E[1] + E[2]*E[2] + 1.0f;
+        float alpha = dotIE / dotEE;
+        float dB = I[0] - alpha*E[0], dG = I[1] - alpha*E[1], dR = I[2] - alpha*E[2];
+        float sigma = std::max(stdDev, 1.0f) * tauCD;
+
+        bool shadow = (dB*dB + dG*dG + dR*dR) < sigma*sigma && alpha >= alphaLow && alpha < alphaHigh;
+        return shadow ? 1 : 2;
+    };
+
+    runInBands(frame.rows, [&](int startRow, int endRow)
+    {
+        for (int r = startRow; r < endRow; r++)
         {
-            for (int c = 0; c < object.miniMask.cols; c++)
+            const uint8_t* framePtr = frame.ptr<uint8_t>(r);
+            const uint8_t* backgroundPtr = background.ptr<uint8_t>(r);
+            const float* stdDevPtr = backgroundStdDev.ptr<float>(r);
+            const uint8_t* fgMaskPtr = foregroundMask.ptr<uint8_t>(r);
+            uint8_t* shadowMaskPtr = shadowMask.ptr<uint8_t>(r);
+            int c = 0;
+
+#ifdef SIMD
+            const __m128 one = _mm_set1_ps(1.0);
+            const __m128 tauCD4 = _mm_set1_ps(tauCD);
+            const __m128 alphaLow4 = _mm_set1_ps(alphaLow), alphaHigh4 = _mm_set1_ps(alphaHigh);
+            const __m128i zero = _mm_setzero_si128();
+
+            // 16 bytes are loaded for every 4 pixels, so stop 2 pixels early to stay within the row
+            for (; c + 6 <= cols; c += 4)
             {
-                if (object.miniMask.at<uint8_t>(r, c) == 0 || segmentLabels.at<uint16_t>(r, c) != 0)
+                uint32_t fg4;
+                memcpy(&fg4, fgMaskPtr + c, sizeof(fg4));
+                if (fg4 == 0)
+                {
+                    memcpy(shadowMaskPtr + c, &fg4, sizeof(fg4));
                     continue;
-                
-                findSegment(object, Point(r, c), segmentLabels, ++currentLabel, grThr);
+                }
+
+                __m128 IB, IG, IR, EB, EG, ER;
+                deinterleaveBGR(framePtr + 3*c, IB, IG, IR);
+                deinterleaveBGR(backgroundPtr + 3*c, EB, EG, ER);
+
+                __m128 dotIE = _mm_add_ps(_mm_add_ps(_mm_mul_ps(IB, EB), _mm_mul_ps(IG, EG)), _mm_mul_ps(IR, ER));
+                __m128 dotEE = _mm_add_ps(_mm_add_ps(_mm_mul_ps(EB, EB), _mm_mul_ps(EG, EG)), _mm_mul_ps(ER, ER));
+                __m128 alpha = _mm_div_ps(dotIE, _mm_add_ps(dotEE, one));
+
+                __m128 dB = _mm_sub_ps(IB, _mm_mul_ps(alpha, EB));
+                __m128 dG = _mm_sub_ps(IG, _mm_mul_ps(alpha, EG));
+                __m128 dR = _mm_sub_ps(IR, _mm_mul_ps(alpha, ER));
+                __m128 cd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dB, dB), _mm_mul_ps(dG, dG)), _mm_mul_ps(dR, dR));
+
+                __m128 sigma = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(stdDevPtr + c), one), tauCD4);
+                __m128 shadow = _mm_cmplt_ps(cd, _mm_mul_ps(sigma, sigma));
+                shadow = _mm_and_ps(shadow, _mm_cmpge_ps(alpha, alphaLow4));
+                shadow = _mm_and_ps(shadow, _mm_cmplt_ps(alpha, alphaHigh4));
+
+                // 1 for shadow, 2 for foreground, 0 if pixel isn't foreground at all
+                __m128i shadowi = _mm_castps_si128(shadow);
+                __m128i result = _mm_or_si128(_mm_and_si128(shadowi, _mm_set1_epi32(1)),
+                                              _mm_andnot_si128(shadowi, _mm_set1_epi32(2)));
+                __m128i fg = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(fg4), zero), zero);
+                result = _mm_andnot_si128(_mm_cmpeq_epi32(fg, zero), result);
+
+                result = _mm_packs_epi32(result, result);
+                result = _mm_packus_epi16(result, result);
+                uint32_t out = _mm_cvtsi128_si32(result);
+                memcpy(shadowMaskPtr + c, &out, sizeof(out));
             }
+#endif
+
+            for (; c < cols; c++)
+                shadowMaskPtr[c] = fgMaskPtr[c] != 0 ? 
+                    classifyPixel(framePtr + 3*c, backgroundPtr + 3*c, stdDevPtr[c]) : 0;
         }
+    });
+}
 
-        object.segmentLabels = segmentLabels;
-    }
+Rect Shadows::haloRect(const Rect& rect, const Size& frameSize)
+{
+    // half of edge correction kernel size
+    const int halo = 2;
+    Rect expanded(rect.x - halo, rect.y - halo, rect.width + 2*halo, rect.height + 2*halo);
+    return expanded & Rect(0, 0, frameSize.width, frameSize.height);
+}
 
-    // at this point, each moving object is divided into segments and labeled.
+float Shadows::autoGradientThreshold(const MovingObject& object, InputArray _bg, InputArray _bgStdDev)
+{
+    Mat background = _bg.getMat(), backgroundStdDev = _bgStdDev.getMat();
 
-    Mat globalSegmentMap = Mat::zeros(frame.size(), CV_16U);
-    uint32_t globalSegmentCounter = 0;
+    // calculate gradient threshold
+    float objSize = countNonZero(object.miniMask);
+    Mat objBg, objStdDev;
+    background(object.selector).copyTo(objBg, object.miniMask);
+    backgroundStdDev(object.selector).copyTo(objStdDev, object.miniMask);
 
-    if (params.edgeCorrection)
-        erode(objectLabels, objectLabels, getStructuringElement(MORPH_RECT, Size(5,5)));
+    Scalar meanSum = cv::sum(objBg);
+    Scalar stdDevSum = cv::sum(objStdDev);
 
+    float grThr = params.alpha / objSize;
+    grThr *= meanSum[0] * stdDevSum[0] / objSize; 
+    grThr *= params.gradientThresholdMultiplier;
 #if DEBUG
-    Mat luminanceCritetion = Mat::zeros(frame.size(), CV_8U);
-    Mat sizeCriterion = Mat::zeros(frame.size(), CV_8U);
-    Mat externalPointsCriterion = Mat::zeros(frame.size(), CV_8U);
+    std::cout << "ID: " << object.ID << ", threshold: " << grThr << ", obj size: " 
+              << objSize << std::endl;
 #endif
 
-    for (MovingObject& object: movingObjects)
-    {
-        auto& segmentLabels = object.segmentLabels;
-        const auto selector = object.selector;
-        globalSegmentMap(selector) += segmentLabels;
+    return grThr;
+}
 
-        for (Segment& segment: object.segments)
-        {
-            globalSegmentCounter++;
-
-            // luminance criterion  (eq. 10)
-            Scalar mean = cv::mean(D(selector), segment.mask);
-            bool luminance_ok = (mean[0] > params.luminanceThreshold) && 
-                                (mean[1] > params.luminanceThreshold) && 
-                                (mean[2] > params.luminanceThreshold);
-            if (!luminance_ok)
-            {
-                // it's surely foreground
-                shadowMask(selector).setTo(2, segment.mask);
-                continue;
-            }
+void Shadows::classifySegments(MovingObject& object, InputArray _objectLabels, Mat& shadowMask,
+        SegmentationScratch& scratch)
+{
+    TIM_TRACE_SCOPE("shadows.classifySegments");
+    const auto& segmentLabels = object.segmentLabels;
+    const auto selector = object.selector;
+    auto& segmentClasses = scratch.segmentClasses;
+
+    int objectArea = segmentStatistics(object, _objectLabels);
+
+    // classify segments: 0 - undecided, 1 - shadow, 2 - foreground
+    segmentClasses.assign(object.segments.size() + 1, 0);
 #if DEBUG
-            else
-                luminanceCritetion(selector).setTo(1, segment.mask);
+    // bit 0 - luminance criterion, bit 1 - size criterion, bit 2 - extrinsic terminal point criterion
+    std::vector<uint8_t> criteria(object.segments.size() + 1, 0);
 #endif
 
-            // size criterion (eq. 11)
-            bool size_ok = segment.area > params.lambda * countNonZero(object.miniMask);
+    for (size_t idx = 0; idx < object.segments.size(); idx++)
+    {
+        const Segment& segment = object.segments[idx];
+
+        // luminance criterion  (eq. 10)
+        bool luminance_ok = (segment.ratioSum[0] > params.luminanceThreshold * segment.area) && 
+                            (segment.ratioSum[1] > params.luminanceThreshold * segment.area) && 
+                            (segment.ratioSum[2] > params.luminanceThreshold * segment.area);
+        if (!luminance_ok)
+        {
+            // it's surely foreground
+            segmentClasses[idx + 1] = 2;
+            continue;
+        }
+
+        // size criterion (eq. 11)
+        bool size_ok = segment.area > params.lambda * objectArea;
+
+        // extrinsic terminal point criterion (eq. 12)
+        bool extrinsic_ok = (segment.nExternal / float(segment.nTerminal)) > params.tau;
 #if DEBUG
-            if (size_ok)
-                sizeCriterion(selector).setTo(1, segment.mask);
+        criteria[idx + 1] = 1 | (size_ok << 1) | (extrinsic_ok << 2);
 #endif
 
-            // calculate number of internal and external terminal points
-            int nExternal = 0, nAll = 0;
-            auto smallObjectLabels = objectLabels(selector);
+        if (luminance_ok && size_ok && extrinsic_ok)
+            segmentClasses[idx + 1] = 1;
+    }
 
-            for (int r = 0; r < segment.mask.rows; r++)
-            {
-                for (int c = 0; c < segment.mask.cols; c++)
-                {
-                    if (segment.mask.at<uint8_t>(r, c) == 0) continue;
-
-                    uint16_t segmentLabel = segmentLabels.at<uint16_t>(r,c);
-                    uint16_t objectLabel = smallObjectLabels.at<uint16_t>(r,c);
-                    
-                    // first check if we're at the edge of label
-                    if ((r < segmentLabels.rows - 1 && (segmentLabel != segmentLabels.at<uint16_t>(r+1,c))) ||
-                        (c < segmentLabels.cols - 1 && (segmentLabel != segmentLabels.at<uint16_t>(r,c+1))) ||
-                        (r > 0 && (segmentLabel != segmentLabels.at<uint16_t>(r-1,c))) ||
-                        (c > 0 && (segmentLabel != segmentLabels.at<uint16_t>(r,c-1))))
-                    {
-                        // we are.
-                        nAll++;
-
-                        // check if we're at external point
-                        if ((r < smallObjectLabels.rows - 1 && (objectLabel != smallObjectLabels.at<uint16_t>(r+1,c))) ||
-                            (c < smallObjectLabels.cols - 1 && (objectLabel != smallObjectLabels.at<uint16_t>(r,c+1))) ||
-                            (r > 0 && (objectLabel != smallObjectLabels.at<uint16_t>(r-1,c))) ||
-                            (c > 0 && (objectLabel != smallObjectLabels.at<uint16_t>(r,c-1))))
-                        //if ((r < smallObjectLabels.rows - 1 && (0 == smallObjectLabels.at<uint16_t>(r+1,c))) ||
-                        //  (c < smallObjectLabels.cols - 1 && (0 == smallObjectLabels.at<uint16_t>(r,c+1))) ||
-                        //  (r > 0 && (0 == smallObjectLabels.at<uint16_t>(r-1,c))) ||
-                        //  (c > 0 && (0 == smallObjectLabels.at<uint16_t>(r,c-1))))
-
-                        {
-                            nExternal++;
-                        }
-                    }
-                }
-            }
+    Mat objectShadowMask = shadowMask(selector);
+    for (int r = 0; r < segmentLabels.rows; r++)
+    {
+        const uint16_t* labelPtr = segmentLabels.ptr<uint16_t>(r);
+        uint8_t* shadowMaskPtr = objectShadowMask.ptr<uint8_t>(r);
+
+        for (int c = 0; c < segmentLabels.cols; c++)
+        {
+            if (labelPtr[c] == 0) continue;
 
-            // extrinsic terminal point criterion (eq. 12)
-            bool extrinsic_ok = (nExternal / float(nAll)) > params.tau;
+            uint8_t segmentClass = segmentClasses[labelPtr[c]];
+            if (segmentClass != 0)
+                shadowMaskPtr[c] = segmentClass;
 #if DEBUG
-            if (extrinsic_ok)
-                externalPointsCriterion(selector).setTo(1, segment.mask);
+            uint8_t flags = criteria[labelPtr[c]];
+            luminanceCritetion(selector).at<uint8_t>(r, c) = flags & 1;
+            sizeCriterion(selector).at<uint8_t>(r, c) = (flags >> 1) & 1;
+            externalPointsCriterion(selector).at<uint8_t>(r, c) = (flags >> 2) & 1;
 #endif
+        }
+    }
+}
 
-            if (luminance_ok && size_ok && extrinsic_ok)
-                shadowMask(selector).setTo(1, segment.mask);
+bool Shadows::reuseClassification(MovingObject& object, Mat& shadowMask, CachedClassification& entry)
+{
+    TIM_TRACE_SCOPE("shadows.reuseClassification");
+    const Rect& selector = object.selector;
+
+    // find object from previous frame that overlaps the most
+    const CachedClassification* previous = nullptr;
+    float bestOverlap = 0;
+    for (const auto& cached: cache)
+    {
+        if (!cached.valid)
+            continue;
+
+        float overlap = (cached.selector & selector).area() / float((cached.selector | selector).area());
+        if (overlap > bestOverlap)
+        {
+            bestOverlap = overlap;
+            previous = &cached;
         }
     }
 
-#if DEBUG
-    imshow("luminanceCritetion", 255*luminanceCritetion);
-    imshow("sizeCriterion", 255*sizeCriterion);
-    imshow("externalPointsCriterion", 255*externalPointsCriterion);
-    
-    if(globalSegmentCounter != 0)
-        showSegmentation(globalSegmentCounter, globalSegmentMap);
+    if (previous == nullptr || bestOverlap < 0.5 || previous->age + 1 >= params.cacheFrames)
+        return false;
 
-    imshow("shadowMask w/ blanks", (255/2)*shadowMask);
+    // previous classification is moved by displacement of bounding box centre.
+    // pixel (r, c) of current object corresponds to pixel (r + dy, c + dx) of previous one.
+    const int dx = previous->selector.width / 2 - selector.width / 2;
+    const int dy = previous->selector.height / 2 - selector.height / 2;
+    const Mat& objectMask = object.miniMask;
+    Mat D_roi = D(selector);
+
+    // returns class of corresponding pixel in previous frame, 
+    // or 0 if there's no such pixel or its ratio changed too much
+    auto warpedClass = [&](int r, int c) -> uint8_t
+    {
+        int pr = r + dy, pc = c + dx;
+        if (pr < 0 || pc < 0 || pr >= previous->classes.rows || pc >= previous->classes.cols)
+            return 0;
+
+        const Vec3f& ratio = D_roi.at<Vec3f>(r, c);
+        const Vec3f& previousRatio = previous->ratio.at<Vec3f>(pr, pc);
+        if (std::abs(ratio[0] - previousRatio[0]) > params.cacheRatioThreshold ||
+            std::abs(ratio[1] - previousRatio[1]) > params.cacheRatioThreshold ||
+            std::abs(ratio[2] - previousRatio[2]) > params.cacheRatioThreshold)
+            return 0;
+
+        return previous->classes.at<uint8_t>(pr, pc);
+    };
+
+    int area = 0, nChanged = 0;
+    for (int r = 0; r < objectMask.rows; r++)
+    {
+        const uint8_t* maskPtr = objectMask.ptr<uint8_t>(r);
+        for (int c = 0; c < objectMask.cols; c++)
+        {
+            if (maskPtr[c] == 0) continue;
+
+            area++;
+            nChanged += warpedClass(r, c) == 0;
+        }
+    }
+
+    if (nChanged > params.cacheMaxChange * area)
+        return false;
+
+    // changed pixels are left undecided, they'll be filled in with labels of their neighbours
+    Mat objectShadowMask = shadowMask(selector);
+    entry.classes = Mat::zeros(selector.size(), CV_8U);
+    for (int r = 0; r < objectMask.rows; r++)
+    {
+        const uint8_t* maskPtr = objectMask.ptr<uint8_t>(r);
+        uint8_t* shadowMaskPtr = objectShadowMask.ptr<uint8_t>(r);
+        uint8_t* classesPtr = entry.classes.ptr<uint8_t>(r);
+
+        for (int c = 0; c < objectMask.cols; c++)
+        {
+            if (maskPtr[c] == 0) continue;
+
+            uint8_t segmentClass = warpedClass(r, c);
+            classesPtr[c] = segmentClass;
+            if (segmentClass != 0)
+                shadowMaskPtr[c] = segmentClass;
+        }
+    }
+
+    entry.selector = selector;
+    D_roi.copyTo(entry.ratio);
+    entry.age = previous->age + 1;
+    entry.valid = true;
+    object.segments.clear();
+    object.segmentLabels.release();
+
+    return true;
+}
+
+void Shadows::forEachObject(std::vector<MovingObject>& objects,
+        const std::function<void(MovingObject&, SegmentationScratch&)>& func)
+{
+#ifdef MULTITHREADING
+    if (!params.parallelObjects)
+    {
+        for (auto& object: objects)
+            func(object, scratch[0]);
+        return;
+    }
+
+    // objects differ a lot in size, so instead of splitting them evenly
+    // every task takes next unprocessed object until there are none left
+    std::atomic<size_t> nextObject(0);
+    int nTasks = std::min<size_t>(nThreads, objects.size());
+    std::vector<std::future<void>> results;
+
+    for (int task = 0; task < nTasks; task++)
+    {
+        results.emplace_back(WorkerPool::instance().enqueue([&, task]()
+        {
+            TIM_TRACE_SCOPE("shadows.worker");
+#ifdef PERF_COUNTERS
+            PerfSample before = PerfCounters::threadCounters().read();
 #endif
+            for (size_t idx = nextObject++; idx < objects.size(); idx = nextObject++)
+            {
+                TIM_TRACE_SCOPE("shadows.object");
+                func(objects[idx], scratch[task]);
+            }
+#ifdef PERF_COUNTERS
+            workerCounters.add(PerfCounters::threadCounters().read() - before);
+#endif
+        }));
+    }
 
-    fillInBlanks(foregroundMask, shadowMask);
-    //showSegmentation(nLabels, objectLabels);
-    
-    Mat onlyShadows = (shadowMask == 1);
-    for (auto& obj: movingObjects)
+    for(auto&& r: results)
+        r.get();
+#else
+    for (auto& object: objects)
+        func(object, scratch[0]);
+#endif
+}
+
+void Shadows::computeRatio(InputArray _src, InputArray _bg, const Rect& selector)
+{
+    TIM_TRACE_SCOPE("shadows.computeRatio");
+    // D = (background + 1) / (frame + 1), for every channel.
+    // each row of bounding box is processed as a flat array of 3*width bytes.
+    Mat frame = _src.getMat()(selector), background = _bg.getMat()(selector), D_roi = D(selector);
+    const int n = 3 * selector.width;
+
+    for (int r = 0; r < selector.height; r++)
     {
-        obj.mask -= onlyShadows;
-        obj.minimizeMask();
+        const uint8_t* framePtr = frame.ptr<uint8_t>(r);
+        const uint8_t* backgroundPtr = background.ptr<uint8_t>(r);
+        float* ratioPtr = D_roi.ptr<float>(r);
+        int idx = 0;
+
+#ifdef SIMD
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 one = _mm_set1_ps(1.0), two = _mm_set1_ps(2.0);
+
+        for (; idx + 16 <= n; idx += 16)
+        {
+            __m128i bg = _mm_loadu_si128((const __m128i*)(backgroundPtr + idx));
+            __m128i fr = _mm_loadu_si128((const __m128i*)(framePtr + idx));
+
+            // widen 16 bytes to 2x8 16-bit ints
+            __m128i bg16[2] = { _mm_unpacklo_epi8(bg, zero), _mm_unpackhi_epi8(bg, zero) };
+            __m128i fr16[2] = { _mm_unpacklo_epi8(fr, zero), _mm_unpackhi_epi8(fr, zero) };
+
+            for (int i = 0; i < 4; i++)
+            {
+                // widen to 32-bit ints and convert to float
+                __m128i bg32 = (i % 2 == 0) ? _mm_unpacklo_epi16(bg16[i/2], zero) 
+                                            : _mm_unpackhi_epi16(bg16[i/2], zero);
+                __m128i fr32 = (i % 2 == 0) ? _mm_unpacklo_epi16(fr16[i/2], zero) 
+                                            : _mm_unpackhi_epi16(fr16[i/2], zero);
+                __m128 bgF = _mm_add_ps(_mm_cvtepi32_ps(bg32), one);
+                __m128 frF = _mm_add_ps(_mm_cvtepi32_ps(fr32), one);
+
+                // reciprocal with one Newton-Raphson step: rcp = rcp * (2 - x * rcp)
+                __m128 rcp = _mm_rcp_ps(frF);
+                rcp = _mm_mul_ps(rcp, _mm_sub_ps(two, _mm_mul_ps(frF, rcp)));
+
+                _mm_storeu_ps(ratioPtr + idx + 4*i, _mm_mul_ps(bgF, rcp));
+            }
+        }
+#endif
+
+        for (; idx < n; idx++)
+            ratioPtr[idx] = (backgroundPtr[idx] + 1.0f) / (framePtr[idx] + 1.0f);
     }
-    
-    shadowMask.copyTo(_dst);
 }
 
-void Shadows::findSegment(MovingObject& object, Point startPoint, InputOutputArray _segmentLabels, 
-         uint16_t label, float gradientThreshold)
+void Shadows::segmentObjects(InputArray _ratio, std::vector<MovingObject>& movingObjects)
 {
-    Mat labels = _segmentLabels.getMat(), objectMask = object.miniMask, 
-        segmentMask = Mat::zeros(objectMask.size(), CV_8U),
-        visited = Mat::zeros(objectMask.size(), CV_8U); 
+    D = _ratio.getMat();
+    for (MovingObject& object: movingObjects)
+        labelSegments(object, params.gradientThreshold, scratch[0]);
+}
 
-    std::vector<Point> stack;
-    int area = 0;
+void Shadows::labelSegments(MovingObject& object, float gradientThreshold, SegmentationScratch& scratch)
+{
+    TIM_TRACE_SCOPE("shadows.labelSegments");
+    // two-scan union-find labelling. a pixel joins its left or upper neighbour if its ratio
+    // is close enough to the ratio of that segment's seed (first pixel of the segment in raster order).
+    // segments are merged only if all pixels of the younger one are close to the seed of the older one,
+    // so like in seed flood fill, every pixel of a segment is close to its seed and segments can't
+    // chain across gradual changes.
+    const Mat& objectMask = object.miniMask;
     Mat D_roi = D(object.selector);
+    const int rows = objectMask.rows, cols = objectMask.cols;
+    auto& provisionalLabels = scratch.provisionalLabels;
+    auto& parents = scratch.parents;
+    auto& provisionalAreas = scratch.provisionalAreas;
+    auto& finalLabels = scratch.finalLabels;
+    auto& seedRatios = scratch.seedRatios;
+    auto& minRatios = scratch.minRatios;
+    auto& maxRatios = scratch.maxRatios;
+
+    provisionalLabels.assign(rows * cols, 0);
+    parents.assign(1, 0);
+    provisionalAreas.assign(1, 0);
+    seedRatios.assign(1, Vec3f());
+    minRatios.assign(1, Vec3f());
+    maxRatios.assign(1, Vec3f());
+
+    auto findRoot = [&](uint32_t label)
+    {
+        while (parents[label] != label)
+        {
+            parents[label] = parents[parents[label]];
+            label = parents[label];
+        }
+        return label;
+    };
 
-    // remember points in case segment turns out to be too small
-    std::vector<Point> visitedPoints; 
+    auto similar = [&](const Vec3f& ratio1, const Vec3f& ratio2)
+    {
+        return gradientThreshold > std::abs(ratio1[0] - ratio2[0]) &&
+               gradientThreshold > std::abs(ratio1[1] - ratio2[1]) &&
+               gradientThreshold > std::abs(ratio1[2] - ratio2[2]);
+    };
+
+    // range of ratios of segment 'label' lies within gradientThreshold from 'seed'
+    auto withinThreshold = [&](uint32_t label, const Vec3f& seed)
+    {
+        for (int ch = 0; ch < 3; ch++)
+            if (gradientThreshold <= maxRatios[label][ch] - seed[ch] ||
+                gradientThreshold <= seed[ch] - minRatios[label][ch])
+                return false;
+        return true;
+    };
 
-    stack.push_back(startPoint);
-    while(!stack.empty())
+    // first scan: assign provisional labels and record equivalences
+    for (int r = 0; r < rows; r++)
     {
-        auto checkPoint = [&](Point p)
+        const uint8_t* maskPtr = objectMask.ptr<uint8_t>(r);
+        const Vec3f* ratioPtr = D_roi.ptr<Vec3f>(r);
+        uint32_t* labelPtr = provisionalLabels.data() + r * cols;
+        // first row has no upper neighbours, pointer before the buffer mustn't even be formed
+        const uint32_t* upperPtr = r > 0 ? labelPtr - cols : nullptr;
+
+        for (int c = 0; c < cols; c++)
         {
-            Vec3f ratio1 = D_roi.at<Vec3f>(startPoint.x, startPoint.y);
-            Vec3f ratio2 = D_roi.at<Vec3f>(p.x, p.y);
+            if (maskPtr[c] == 0) continue;
+
+            const Vec3f& ratio = ratioPtr[c];
+            uint32_t left = (c > 0 && labelPtr[c-1] != 0) ? findRoot(labelPtr[c-1]) : 0;
+            uint32_t upper = (upperPtr && upperPtr[c] != 0) ? findRoot(upperPtr[c]) : 0;
 
-            if (gradientThreshold > abs(ratio1[0] - ratio2[0]) &&
-                gradientThreshold > abs(ratio1[1] - ratio2[1]) &&
-                gradientThreshold > abs(ratio1[2] - ratio2[2]))
+            if (left != 0 && !similar(ratio, seedRatios[left]))
+                left = 0;
+            if (upper != 0 && !similar(ratio, seedRatios[upper]))
+                upper = 0;
+
+            uint32_t label;
+            if (left != 0 && upper != 0)
             {
-                stack.push_back(p);
-                visitedPoints.push_back(p);
-                return true;
+                // pixel connects two segments. older one takes it, younger one
+                // is merged into it only if all its pixels are close to the older seed.
+                label = std::min(left, upper);
+                uint32_t younger = std::max(left, upper);
+                if (left != upper && withinThreshold(younger, seedRatios[label]))
+                {
+                    parents[younger] = label;
+                    for (int ch = 0; ch < 3; ch++)
+                    {
+                        minRatios[label][ch] = std::min(minRatios[label][ch], minRatios[younger][ch]);
+                        maxRatios[label][ch] = std::max(maxRatios[label][ch], maxRatios[younger][ch]);
+                    }
+                }
             }
-            return false;
-        };
-        
-        Point p1 = stack[stack.size() - 1]; 
-
-        visited.at<uint8_t>(p1.x, p1.y) = 1;
-        labels.at<uint16_t>(p1.x, p1.y) = label;
-        segmentMask.at<uint8_t>(p1.x, p1.y) = 1;
-        area++;
-        
-        if (p1.x < labels.rows - 1 && !visited.at<uint8_t>(p1.x+1, p1.y) && objectMask.at<uint8_t>(p1.x+1,p1.y) != 0)
-            if(checkPoint(Point(p1.x+1, p1.y))) continue;
-        if (p1.y < labels.cols - 1 && !visited.at<uint8_t>(p1.x,p1.y+1) && objectMask.at<uint8_t>(p1.x,p1.y+1) != 0)
-            if(checkPoint(Point(p1.x, p1.y+1))) continue;
-        if (p1.x > 0 && !visited.at<uint8_t>(p1.x-1, p1.y) && objectMask.at<uint8_t>(p1.x-1,p1.y) != 0)
-            if(checkPoint(Point(p1.x-1, p1.y))) continue;
-        if (p1.y > 0 && !visited.at<uint8_t>(p1.x,p1.y-1) && objectMask.at<uint8_t>(p1.x,p1.y-1) != 0)
-            if(checkPoint(Point(p1.x, p1.y-1))) continue;
-
-        stack.pop_back();
+            else if (left != 0 || upper != 0)
+                label = left != 0 ? left : upper;
+            else
+            {
+                // new seed
+                label = parents.size();
+                parents.push_back(label);
+                provisionalAreas.push_back(0);
+                seedRatios.push_back(ratio);
+                minRatios.push_back(ratio);
+                maxRatios.push_back(ratio);
+            }
+
+            labelPtr[c] = label;
+            provisionalAreas[label]++;
+            for (int ch = 0; ch < 3; ch++)
+            {
+                minRatios[label][ch] = std::min(minRatios[label][ch], ratio[ch]);
+                maxRatios[label][ch] = std::max(maxRatios[label][ch], ratio[ch]);
+            }
+        }
     }
 
-    if (area < params.minSegmentSize)
+    // resolve equivalences, sum up areas and assign consecutive labels to segments
+    // that are big enough. pixels of too small segments stay unlabelled (0).
+    const uint32_t nProvisional = parents.size();
+    for (uint32_t label = nProvisional - 1; label > 0; label--)
     {
-        // area is too small, so revert labelling at every visited pixel
-        for (auto& p: visitedPoints)
-            labels.at<uint16_t>(p.x, p.y) = 0;
+        uint32_t root = findRoot(label);
+        if (root != label)
+            provisionalAreas[root] += provisionalAreas[label];
     }
-    else
-        object.segments.emplace_back(segmentMask, area);
+
+    finalLabels.assign(nProvisional, 0);
+    object.segments.clear();
+    uint16_t nSegments = 0;
+    for (uint32_t label = 1; label < nProvisional; label++)
+    {
+        if (parents[label] == label && (int)provisionalAreas[label] >= params.minSegmentSize &&
+            nSegments < UINT16_MAX)
+        {
+            // segment #i has label i+1
+            finalLabels[label] = ++nSegments;
+            object.segments.emplace_back(provisionalAreas[label]);
+        }
+    }
+
+    // second scan: write final labels
+    Mat segmentLabels(objectMask.size(), CV_16U);
+    for (int r = 0; r < rows; r++)
+    {
+        const uint32_t* labelPtr = provisionalLabels.data() + r * cols;
+        uint16_t* segmentLabelsPtr = segmentLabels.ptr<uint16_t>(r);
+
+        for (int c = 0; c < cols; c++)
+            segmentLabelsPtr[c] = labelPtr[c] != 0 ? finalLabels[findRoot(labelPtr[c])] : 0;
+    }
+
+    object.segmentLabels = segmentLabels;
+}
+
+int Shadows::segmentStatistics(MovingObject& object, InputArray _objectLabels)
+{
+    TIM_TRACE_SCOPE("shadows.segmentStatistics");
+    // single pass over object's segment labels. for every segment accumulate sum of D,
+    // number of terminal (boundary) points and number of external terminal points,
+    // i.e. points that lie on the boundary of the object as well. returns object's area.
+    Mat segmentLabels = object.segmentLabels, objectLabels = _objectLabels.getMat(),
+        D_roi = D(object.selector);
+    const Mat& objectMask = object.miniMask;
+    const int rows = segmentLabels.rows, cols = segmentLabels.cols;
+    int objectArea = 0;
+
+    for (int r = 0; r < rows; r++)
+    {
+        const uint8_t* maskPtr = objectMask.ptr<uint8_t>(r);
+        const Vec3f* ratioPtr = D_roi.ptr<Vec3f>(r);
+        const uint16_t* labelPtr = segmentLabels.ptr<uint16_t>(r);
+        const uint16_t* upperLabelPtr = r > 0 ? segmentLabels.ptr<uint16_t>(r-1) : nullptr;
+        const uint16_t* lowerLabelPtr = r < rows - 1 ? segmentLabels.ptr<uint16_t>(r+1) : nullptr;
+        const uint16_t* objectPtr = objectLabels.ptr<uint16_t>(r);
+        const uint16_t* upperObjectPtr = r > 0 ? objectLabels.ptr<uint16_t>(r-1) : nullptr;
+        const uint16_t* lowerObjectPtr = r < rows - 1 ? objectLabels.ptr<uint16_t>(r+1) : nullptr;
+
+        for (int c = 0; c < cols; c++)
+        {
+            objectArea += maskPtr[c] != 0;
+
+            uint16_t label = labelPtr[c];
+            if (label == 0) continue;
+
+            Segment& segment = object.segments[label - 1];
+            segment.ratioSum[0] += ratioPtr[c][0];
+            segment.ratioSum[1] += ratioPtr[c][1];
+            segment.ratioSum[2] += ratioPtr[c][2];
+
+            // first check if we're at the edge of label
+            if ((lowerLabelPtr && lowerLabelPtr[c] != label) ||
+                (c < cols - 1 && labelPtr[c+1] != label) ||
+                (upperLabelPtr && upperLabelPtr[c] != label) ||
+                (c > 0 && labelPtr[c-1] != label))
+            {
+                // we are.
+                segment.nTerminal++;
+
+                // check if we're at external point
+                uint16_t objectLabel = objectPtr[c];
+                if ((lowerObjectPtr && lowerObjectPtr[c] != objectLabel) ||
+                    (c < cols - 1 && objectPtr[c+1] != objectLabel) ||
+                    (upperObjectPtr && upperObjectPtr[c] != objectLabel) ||
+                    (c > 0 && objectPtr[c-1] != objectLabel))
+                {
+                    segment.nExternal++;
+                }
+            }
+        }
+    }
+
+    return objectArea;
 }
 
 void Shadows::fillInBlanks(InputArray _fgMask, InputArray _mask)
 {
+    TIM_TRACE_SCOPE("shadows.fillInBlanks");
+    // every unlabelled foreground pixel gets the label of the nearest labelled pixel 
+    // in the same row or column. nearest labels are found with two sweeps along rows
+    // and two sweeps along columns, so it's O(N) regardless of how big the blanks are.
+    // labels are looked up in the mask as it was before filling, so order of pixels doesn't matter.
     Mat fgMask = _fgMask.getMat(), mask = _mask.getMat();
+    const int rows = mask.rows, cols = mask.cols;
+    const uint16_t infinity = UINT16_MAX;
 
-    auto findDistance = [&](int deltaR, int deltaC, int startR, int startC)
-    {
-        int r = startR, c = startC;
-        int distance = 0;
-        int value = 0;
+    nearestDistances.resize(rows * cols);
+    nearestLabels.resize(rows * cols);
+    columnDistances.resize(cols);
+    columnLabels.resize(cols);
 
-        while(r >= 0 && c >= 0 && r <= mask.rows && c <= mask.cols)
+    // row sweeps, rows are independent
+    runInBands(rows, [&](int startRow, int endRow)
+    {
+        for (int r = startRow; r < endRow; r++)
         {
-            if (mask.at<uint8_t>(r,c) != 0)
+            const uint8_t* maskPtr = mask.ptr<uint8_t>(r);
+            uint16_t* distPtr = nearestDistances.data() + r * cols;
+            uint8_t* labelPtr = nearestLabels.data() + r * cols;
+
+            uint16_t dist = infinity;
+            uint8_t label = 0;
+            for (int c = 0; c < cols; c++)
             {
-                value = mask.at<uint8_t>(r,c);
-                break;
+                dist = maskPtr[c] != 0 ? 0 : dist + (dist != infinity);
+                label = maskPtr[c] != 0 ? maskPtr[c] : label;
+                distPtr[c] = dist;
+                labelPtr[c] = label;
             }
 
-            r += deltaR;
-            c += deltaC;
-            distance++;
+            dist = infinity;
+            label = 0;
+            for (int c = cols - 1; c >= 0; c--)
+            {
+                dist = maskPtr[c] != 0 ? 0 : dist + (dist != infinity);
+                label = maskPtr[c] != 0 ? maskPtr[c] : label;
+                if (dist < distPtr[c])
+                {
+                    distPtr[c] = dist;
+                    labelPtr[c] = label;
+                }
+            }
         }
+    });
 
-        return std::make_tuple(distance, value);
-    };
-
-    // first of all, make a list of all unlabeled pixels
-    std::vector<Point> unlabeled;
-    for (int r = 0; r < fgMask.rows; r++)
+    // column sweeps, columns are independent. going row by row keeps memory accesses
+    // sequential and lets the compiler vectorize inner loops.
+    runInBands(cols, [&](int startCol, int endCol)
     {
-        for (int c = 0; c < fgMask.cols; c++)
+        auto sweep = [&](int r)
         {
-            if (fgMask.at<uint8_t>(r,c) == 0 || (fgMask.at<uint8_t>(r,c) != 0 && mask.at<uint8_t>(r,c) != 0))
-                continue;
+            const uint8_t* maskPtr = mask.ptr<uint8_t>(r);
+            uint16_t* distPtr = nearestDistances.data() + r * cols;
+            uint8_t* labelPtr = nearestLabels.data() + r * cols;
 
-            unlabeled.emplace_back(r,c);
-        }
-    }
+            for (int c = startCol; c < endCol; c++)
+            {
+                uint16_t dist = maskPtr[c] != 0 ? 0 : columnDistances[c] + (columnDistances[c] != infinity);
+                uint8_t label = maskPtr[c] != 0 ? maskPtr[c] : columnLabels[c];
+                columnDistances[c] = dist;
+                columnLabels[c] = label;
+
+                bool closer = dist < distPtr[c];
+                distPtr[c] = closer ? dist : distPtr[c];
+                labelPtr[c] = closer ? label : labelPtr[c];
+            }
+        };
 
-    if (params.randomReconstruction)
-        std::random_shuffle(unlabeled.begin(), unlabeled.end());
+        std::fill(columnDistances.begin() + startCol, columnDistances.begin() + endCol, infinity);
+        std::fill(columnLabels.begin() + startCol, columnLabels.begin() + endCol, 0);
+        for (int r = 0; r < rows; r++)
+            sweep(r);
 
-    // now iterate over prepared list
-    for (Point& p: unlabeled)
-    {
-        int r = p.x; int c = p.y;
+        std::fill(columnDistances.begin() + startCol, columnDistances.begin() + endCol, infinity);
+        std::fill(columnLabels.begin() + startCol, columnLabels.begin() + endCol, 0);
+        for (int r = rows - 1; r >= 0; r--)
+        {
+            sweep(r);
+
+            // nearest labels in this row are final now and rows below are already swept,
+            // so it's safe to fill in blanks
+            const uint8_t* fgMaskPtr = fgMask.ptr<uint8_t>(r);
+            uint8_t* maskPtr = mask.ptr<uint8_t>(r);
+            const uint8_t* labelPtr = nearestLabels.data() + r * cols;
+            for (int c = startCol; c < endCol; c++)
+                maskPtr[c] = (fgMaskPtr[c] != 0 && maskPtr[c] == 0) ? labelPtr[c] : maskPtr[c];
+        }
+    });
+}
 
-        auto right = findDistance(1, 0, r, c);
-        auto left = findDistance(-1, 0, r, c);
-        auto up = findDistance(0, 1, r, c);
-        auto down = findDistance(0, -1, r, c);
+void Shadows::runInBands(int length, const std::function<void(int, int)>& func)
+{
+#ifdef MULTITHREADING
+    int bandSize = (length + nThreads - 1) / nThreads;
+    std::vector<std::future<void>> results;
 
-        std::vector<decltype(right)> pairs = { right, left, up, down };
-        auto it = std::min_element(pairs.begin(), pairs.end(), [](decltype(right)& a, decltype(right)& b)
-                { return std::get<0>(a) < std::get<0>(b); });
+    for (int start = 0; start < length; start += bandSize)
+        results.emplace_back(WorkerPool::instance().enqueue(func, start, std::min(start + bandSize, length)));
 
-        mask.at<uint8_t>(r,c) = std::get<1>(*it);
-    }   
+    for(auto&& r: results)
+        r.get();
+#else
+    func(0, length);
+#endif
 }
 
 void Shadows::showSegmentation(int nSegments, InputArray _labels)
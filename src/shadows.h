@@ -3,14 +3,29 @@
 
 #include "movingobject.h"
 #include "json11.hpp"
+#include "perfcounters.h"
+#include <functional>
+#include "workerpool.h"
 
 using namespace cv;
 
 struct ShadowsParameters
 {
     float gradientThreshold, gradientThresholdMultiplier, lambda, tau, alpha, luminanceThreshold;
-    bool edgeCorrection, autoGradientThreshold, randomReconstruction;
+    bool edgeCorrection, autoGradientThreshold;
     int minObjectSize, minSegmentSize;
+    // "shadowParallelObjects": objects are processed by shared worker pool (with MULTITHREADING)
+    bool parallelObjects;
+
+    // classification of an object is reused for at most cacheFrames frames (0 disables it),
+    // as long as ratio of no more than cacheMaxChange of its pixels changed by more than cacheRatioThreshold
+    int cacheFrames;
+    float cacheRatioThreshold, cacheMaxChange;
+
+    // "shadowEngine": "chromaticity" replaces region growing with per-pixel 
+    // brightness/chromaticity distortion test
+    bool chromaticityEngine;
+    float chromaticityThreshold, brightnessLow, brightnessHigh;
 
     void parse(const json11::Json& json);
 };
@@ -18,21 +33,90 @@ struct ShadowsParameters
 class Shadows
 {
     private:
+        // scratch buffers for segmentation, reused across objects and frames.
+        // every worker thread has its own.
+        struct SegmentationScratch
+        {
+            std::vector<uint32_t> provisionalLabels, parents, provisionalAreas;
+            std::vector<uint16_t> finalLabels;
+            std::vector<Vec3f> seedRatios, minRatios, maxRatios;
+            std::vector<uint8_t> segmentClasses;
+        };
+
+        // classification of an object from previous frame
+        struct CachedClassification
+        {
+            Rect selector;
+            // per-pixel class: 0 - undecided, 1 - shadow, 2 - foreground
+            Mat classes;
+            Mat ratio;
+            int age = 0;
+            // buffers of entries are reused, entry holds a classification only if it's valid
+            bool valid = false;
+        };
+
         ShadowsParameters params;
                 
-        void findSegment(MovingObject& object, Point startPoint, InputOutputArray _segmentLabels, 
-                uint16_t label, float gradientThreshold);
-        void fillInBlanks(InputArray _fgMask, InputArray _mask);
+        static Rect haloRect(const Rect& rect, const Size& frameSize);
+        void computeRatio(InputArray _src, InputArray _bg, const Rect& selector);
+        float autoGradientThreshold(const MovingObject& object, InputArray _bg, InputArray _bgStdDev);
+        void labelSegments(MovingObject& object, float gradientThreshold, SegmentationScratch& scratch);
+        int segmentStatistics(MovingObject& object, InputArray _objectLabels);
+        void classifySegments(MovingObject& object, InputArray _objectLabels, Mat& shadowMask,
+                SegmentationScratch& scratch);
+        bool reuseClassification(MovingObject& object, Mat& shadowMask, CachedClassification& entry);
+        void forEachObject(std::vector<MovingObject>& objects,
+                const std::function<void(MovingObject&, SegmentationScratch&)>& func);
+        void classifyPixels(InputArray _src, InputArray _bg, InputArray _bgStdDev, InputArray _fgMask,
+                InputOutputArray _dst);
+        void subtractShadows(std::vector<MovingObject>& movingObjects, InputArray _shadowMask);
+        void runInBands(int length, const std::function<void(int, int)>& func);
         void minimizeObjectMask(MovingObject& obj);
         void showSegmentation(int nSegments, InputArray _labels);
 
+        // valid only inside bounding boxes of objects
         Mat D;
+#if DEBUG
+        Mat luminanceCritetion, sizeCriterion, externalPointsCriterion;
+#endif
+        std::vector<SegmentationScratch> scratch;
+        std::vector<CachedClassification> cache, newCache;
+
+        const Mat edgeCorrectionKernel;
+        Mat erodedLabels;
+        // full-frame buffers reused between frames
+        Mat shadowMask, onlyShadows;
+
+        // scratch buffers for filling in blanks
+        std::vector<uint16_t> nearestDistances, columnDistances;
+        std::vector<uint8_t> nearestLabels, columnLabels;
+
+#ifdef MULTITHREADING
+        int nThreads;
+#endif
+#ifdef PERF_COUNTERS
+        PerfAccumulator workerCounters;
+#endif
         
     public:
         Shadows(const json11::Json& jsonString);
-        void updateParameters(const json11::Json& jsonString);
+        // parameters are only replaced between frames
+        void setParameters(const ShadowsParameters& parameters);
+        bool needsRatio() const;
+#ifdef PERF_COUNTERS
+        // hardware counters of per-object workers
+        PerfAccumulator& getWorkerCounters() { return workerCounters; }
+#endif
         void removeShadows(InputArray _src, InputArray _bg, InputArray _bgStdDev, InputArray _fgMask, 
-                InputArray _objectLabels, std::vector<MovingObject>& movingObjects, OutputArray _dst);
+                InputArray _objectLabels, std::vector<MovingObject>& movingObjects, OutputArray _dst,
+                InputArray _ratio = noArray());
+
+        // single steps of region engine, public so that tim_bench can measure them on their own.
+        // segmentObjects() labels segments of all objects on the calling thread, ratio is
+        // background/frame ratio as calculated by Background::processFrameSIMD().
+        void segmentObjects(InputArray _ratio, std::vector<MovingObject>& movingObjects);
+        // unlabelled foreground pixels of mask get label of the nearest labelled pixel
+        void fillInBlanks(InputArray _fgMask, InputArray _mask);
 };
 
 #endif
@@ -30,6 +30,7 @@ processPixels_SSE2:
     ; RSI -> gaussian
     ; RDX -> currentBackground
     ; RCX -> currentStdDev
+    ; R8 -> ratio (not implemented, ignored)
     ; XMM0 -> learningRate
     ; XMM1 -> initalVariance
     ; XMM2 -> initialWeight
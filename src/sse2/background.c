@@ -5,7 +5,7 @@
 #define etaConst 1.57496099457e+01 //pow(2 * M_PI, 3.0 / 2.0)
 
 uint32_t processPixels_SSE2(const uint8_t* frame, float* gaussian, 
-                            uint8_t* currentBackground, float* currentStdDev,
+                            uint8_t* currentBackground, float* currentStdDev, float* ratio,
                             const float learningRate, const float initialVariance,
                             const float initialWeight, const float foregroundThreshold)
 {
@@ -267,6 +267,38 @@ uint32_t processPixels_SSE2(const uint8_t* frame, float* gaussian,
 
     // save stdDev
     _mm_store_ps(currentStdDev, _mm_sqrt_ps(bgVariance));
+
+    // optionally calculate (bg+1)/(frame+1) for every channel, it's needed by shadow removal.
+    // after transposition above bgB, bgG, bgR and bgT contain BGR of background for pixels #1-#4.
+    if (ratio)
+    {
+        __m128 frT = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(B, G, R, frT);
+        // B: B1 G1 R1 00, G: B2 G2 R2 00, R: B3 G3 R3 00, frT: B4 G4 R4 00
+
+        __m128 bgs[4] = { bgB, bgG, bgR, bgT };
+        __m128 frs[4] = { B, G, R, frT };
+        __m128 one = _mm_set1_ps(1.0), two = _mm_set1_ps(2.0);
+
+        for (int i = 0; i < 4; i++)
+        {
+            __m128 bgF = _mm_add_ps(bgs[i], one);
+            __m128 frF = _mm_add_ps(frs[i], one);
+
+            // reciprocal with one Newton-Raphson step: rcp = rcp * (2 - x * rcp)
+            __m128 rcp = _mm_rcp_ps(frF);
+            rcp = _mm_mul_ps(rcp, _mm_sub_ps(two, _mm_mul_ps(frF, rcp)));
+            frs[i] = _mm_mul_ps(bgF, rcp);
+        }
+
+        // ratio is interleaved, 3 floats per pixel. fourth float of each store is overwritten 
+        // by next one, last pixel is stored without it so nothing past 4th pixel gets written.
+        _mm_storeu_ps(ratio + 0, frs[0]);
+        _mm_storeu_ps(ratio + 3, frs[1]);
+        _mm_storeu_ps(ratio + 6, frs[2]);
+        _mm_storel_pi((__m64*)(ratio + 9), frs[3]);
+        _mm_store_ss(ratio + 11, _mm_movehl_ps(frs[3], frs[3]));
+    }
     
     // return foreground mask
     uint8_t moveMask = _mm_movemask_ps(fgMask);
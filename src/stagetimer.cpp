@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include "stagetimer.h"
+
+const char* StageTimer::stageName(Stage stage)
+{
+    static const char* names[STAGES_NUM] = 
+    {
+        "decode", "resize", "background", "postfilter", "ccl", "shadows", "tracking", "counting", "colours",
+        "recording"
+    };
+
+    return names[stage];
+}
+
+PerfSample StageTimer::readCounters() const
+{
+#ifdef PERF_COUNTERS
+    return PerfCounters::threadCounters().read();
+#else
+    return PerfSample();
+#endif
+}
+
+void StageTimer::startFrame()
+{
+    frameStart = lastLap = Clock::now();
+    std::fill(std::begin(currentFrame), std::end(currentFrame), 0.0);
+
+#ifdef PERF_COUNTERS
+    lastCounters = readCounters();
+    std::fill(std::begin(currentCounters), std::end(currentCounters), PerfSample());
+#endif
+}
+
+void StageTimer::lap(Stage stage)
+{
+    auto now = Clock::now();
+    currentFrame[stage] += std::chrono::duration<double, std::milli>(now - lastLap).count();
+    lastLap = now;
+
+#ifdef PERF_COUNTERS
+    PerfSample counters = readCounters();
+    currentCounters[stage] += counters - lastCounters;
+    lastCounters = counters;
+#endif
+}
+
+void StageTimer::addWorkerCounters(const std::string& name, const PerfSample& sample)
+{
+    workerCounters.emplace_back(name, sample);
+}
+
+void StageTimer::endFrame(bool record)
+{
+    lastFrame = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+    if (!record)
+        return;
+
+    for (int stage = 0; stage < STAGES_NUM; stage++)
+    {
+        stageTimes[stage].push_back(currentFrame[stage]);
+        stageCounters[stage] += currentCounters[stage];
+    }
+
+    frameTimes.push_back(lastFrame);
+}
+
+StageTimer::Summary StageTimer::summarize(std::vector<double> times)
+{
+    Summary summary = {};
+    if (times.empty())
+        return summary;
+
+    std::sort(times.begin(), times.end());
+
+    // nearest-rank percentiles
+    auto percentile = [&](double p)
+    {
+        size_t rank = std::ceil(p / 100.0 * times.size());
+        return times[std::max<size_t>(rank, 1) - 1];
+    };
+
+    summary.mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    summary.p50 = percentile(50);
+    summary.p95 = percentile(95);
+    summary.p99 = percentile(99);
+    summary.max = times.back();
+
+    return summary;
+}
+
+void StageTimer::printReport() const
+{
+    auto printRow = [](const std::string& name, const Summary& s)
+    {
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << s.mean << std::setw(10) << s.p50 << std::setw(10) << s.p95 
+                  << std::setw(10) << s.p99 << std::setw(10) << s.max << std::endl;
+    };
+
+    std::cout << std::left << std::setw(12) << "stage [ms]" << std::right << std::setw(10) << "mean" 
+              << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" 
+              << std::setw(10) << "max" << std::endl;
+
+    for (int stage = 0; stage < STAGES_NUM; stage++)
+        printRow(stageName(Stage(stage)), summarize(stageTimes[stage]));
+    printRow("frame", summarize(frameTimes));
+
+#ifdef PERF_COUNTERS
+    // averages per frame
+    double frames = std::max<size_t>(frameTimes.size(), 1);
+    auto printCounters = [&](const std::string& name, const PerfSample& s)
+    {
+        double ipc = s.cycles > 0 ? double(s.instructions) / s.cycles : 0.0;
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << s.cycles / frames / 1e6 << std::setw(12) << s.instructions / frames / 1e6 
+                  << std::setw(8) << std::setprecision(2) << ipc << std::setprecision(1)
+                  << std::setw(14) << s.llcMisses / frames / 1e3 << std::setw(14) << s.branchMisses / frames / 1e3 
+                  << std::endl;
+    };
+
+    std::cout << std::endl << std::left << std::setw(20) << "per frame" << std::right << std::setw(12) << "Mcycles" 
+              << std::setw(12) << "Minstr" << std::setw(8) << "IPC" << std::setw(14) << "kLLC-misses" 
+              << std::setw(14) << "kbr-misses" << std::endl;
+
+    for (int stage = 0; stage < STAGES_NUM; stage++)
+        printCounters(stageName(Stage(stage)), stageCounters[stage]);
+    for (const auto& worker: workerCounters)
+        printCounters(worker.first, worker.second);
+#endif
+
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+json11::Json StageTimer::jsonReport() const
+{
+    auto toJson = [](const Summary& s)
+    {
+        return json11::Json::object 
+        { 
+            { "mean", s.mean }, { "p50", s.p50 }, { "p95", s.p95 }, { "p99", s.p99 }, { "max", s.max } 
+        };
+    };
+
+    json11::Json::object stages;
+    for (int stage = 0; stage < STAGES_NUM; stage++)
+        stages[stageName(Stage(stage))] = toJson(summarize(stageTimes[stage]));
+
+    json11::Json::object report
+    {
+        { "stages", stages },
+        { "frame", toJson(summarize(frameTimes)) }
+    };
+
+#ifdef PERF_COUNTERS
+    // totals over all recorded frames, doubles are exact up to 2^53
+    auto countersToJson = [](const PerfSample& s)
+    {
+        return json11::Json::object 
+        { 
+            { "cycles", double(s.cycles) }, { "instructions", double(s.instructions) },
+            { "llcMisses", double(s.llcMisses) }, { "branchMisses", double(s.branchMisses) }
+        };
+    };
+
+    json11::Json::object counters;
+    for (int stage = 0; stage < STAGES_NUM; stage++)
+        counters[stageName(Stage(stage))] = countersToJson(stageCounters[stage]);
+    for (const auto& worker: workerCounters)
+        counters[worker.first] = countersToJson(worker.second);
+    report["counters"] = counters;
+#endif
+
+    return report;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,77 @@
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "json11.hpp"
+#include "perfcounters.h"
+
+// measures how long each stage of the pipeline takes in every frame.
+// stages are measured as laps: time between consecutive calls to lap().
+// with PERF_COUNTERS, hardware counters of the calling thread are attributed to stages as well.
+class StageTimer
+{
+    public:
+        enum Stage
+        {
+            DECODE,
+            RESIZE,
+            BACKGROUND,
+            POSTFILTER,
+            CCL,
+            SHADOWS,
+            TRACKING,
+            COUNTING,
+            COLOURS,
+            RECORDING,
+            STAGES_NUM
+        };
+
+        static const char* stageName(Stage stage);
+
+        void startFrame();
+        // time since startFrame() or previous lap() is accounted to 'stage'
+        void lap(Stage stage);
+        // when 'record' is false (warm-up), frame times are thrown away
+        void endFrame(bool record);
+
+        size_t framesRecorded() const { return frameTimes.size(); }
+
+        // times of the last finished frame, recorded or not [ms]
+        double lastStageTime(Stage stage) const { return currentFrame[stage]; }
+        double lastFrameTime() const { return lastFrame; }
+
+        // counters collected by other threads (e.g. thread pool workers), reported as extra rows
+        void addWorkerCounters(const std::string& name, const PerfSample& sample);
+
+        void printReport() const;
+        json11::Json jsonReport() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Summary
+        {
+            double mean, p50, p95, p99, max;
+        };
+
+        Clock::time_point frameStart, lastLap;
+        double currentFrame[STAGES_NUM] = {};
+        double lastFrame = 0;
+
+        // milliseconds
+        std::vector<double> stageTimes[STAGES_NUM];
+        std::vector<double> frameTimes;
+
+        PerfSample lastCounters, currentCounters[STAGES_NUM], stageCounters[STAGES_NUM];
+        std::vector<std::pair<std::string, PerfSample>> workerCounters;
+
+        PerfSample readCounters() const;
+
+        static Summary summarize(std::vector<double> times);
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
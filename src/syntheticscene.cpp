@@ -0,0 +1,162 @@
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include "syntheticscene.h"
+
+bool SyntheticSceneParameters::parse(const std::string& spec)
+{
+    int width, height;
+    unsigned int seedValue;
+    int n = sscanf(spec.c_str(), "%dx%d,%d,%d,%u", &width, &height, &nObjects, &nFrames, &seedValue);
+    if (n < 4 || width < 64 || height < 64 || nObjects < 0 || nFrames <= 0)
+        return false;
+
+    frameSize = Size(width, height);
+    if (n == 5)
+        seed = seedValue;
+
+    return true;
+}
+
+SyntheticScene::SyntheticScene(const SyntheticSceneParameters& parameters, const std::vector<Point2f>& lines) :
+    params(parameters), rng(parameters.seed)
+{
+    createBackground();
+    createVehicles(lines);
+}
+
+void SyntheticScene::createBackground()
+{
+    Size size = params.frameSize;
+
+    // OpenCV's global RNG might be used by someone else, so the scene has its own one
+    RNG fillRng(params.seed);
+
+    // smooth random texture with some road markings
+    Mat coarse(size.height / 8 + 1, size.width / 8 + 1, CV_8UC3);
+    fillRng.fill(coarse, RNG::UNIFORM, Scalar::all(70), Scalar::all(150));
+    resize(coarse, background, size, 0, 0, INTER_LINEAR);
+
+    std::uniform_int_distribution<int> x(0, size.width - 1), y(0, size.height - 1);
+    for (int i = 0; i < 30; i++)
+        line(background, Point(x(rng), y(rng)), Point(x(rng), y(rng)), Scalar::all(200), 
+             std::max(1, size.width / 400), LINE_AA);
+
+    // a few noise patterns, cycled over frames
+    Mat noise(size, CV_8SC3);
+    for (int i = 0; i < 4; i++)
+    {
+        fillRng.fill(noise, RNG::NORMAL, Scalar::all(0), Scalar::all(3));
+
+        noisePositive.emplace_back();
+        noiseNegative.emplace_back();
+        noise.convertTo(noisePositive.back(), CV_8U);
+        noise.convertTo(noiseNegative.back(), CV_8U, -1);
+    }
+}
+
+void SyntheticScene::createVehicles(const std::vector<Point2f>& lines)
+{
+    Size size = params.frameSize;
+    auto toFrame = [&](const Point2f& pt) { return Point2f(pt.x * size.width, pt.y * size.height); };
+    Point2f a0 = toFrame(lines[0]), a1 = toFrame(lines[1]), b0 = toFrame(lines[2]), b1 = toFrame(lines[3]);
+
+    std::uniform_real_distribution<float> along(0.25f, 0.75f), scale(0.8f, 1.2f);
+    std::uniform_int_distribution<int> colour(0, 255), natural(0, 1);
+    int minDuration = 40, maxDuration = std::max(minDuration, std::min(120, params.nFrames - 1));
+    std::uniform_int_distribution<int> duration(minDuration, maxDuration);
+
+    // distance from pt (inside the frame) to the frame border in direction dir
+    auto toBorder = [&](const Point2f& pt, const Point2f& dir)
+    {
+        float distance = std::numeric_limits<float>::max();
+        if (dir.x != 0)
+            distance = std::min(distance, ((dir.x > 0 ? size.width : 0) - pt.x) / dir.x);
+        if (dir.y != 0)
+            distance = std::min(distance, ((dir.y > 0 ? size.height : 0) - pt.y) / dir.y);
+        return std::max(distance, 0.0f);
+    };
+
+    for (int i = 0; i < params.nObjects; i++)
+    {
+        Vehicle vehicle;
+
+        float s = scale(rng);
+        vehicle.size = Size(size.width / 18 * s, size.height / 14 * s);
+        vehicle.colour = Scalar(colour(rng), colour(rng), colour(rng));
+
+        // path crosses both lines at the same relative position and goes on to the frame
+        // border in both directions, plus the size of vehicle and its shadow, so that the
+        // vehicle enters and leaves the frame instead of appearing on the road
+        float t = along(rng);
+        Point2f onFirst = a0 + (a1 - a0) * t, onSecond = b0 + (b1 - b0) * t;
+        Point2f dir = onSecond - onFirst;
+        dir *= 1.0f / std::max(float(norm(dir)), 1.0f);
+        float margin = 2.0f * (vehicle.size.width + vehicle.size.height);
+        vehicle.start = onFirst - dir * (toBorder(onFirst, -dir) + margin);
+        vehicle.end = onSecond + dir * (toBorder(onSecond, dir) + margin);
+
+        if (natural(rng))
+            nNatural++;
+        else
+            std::swap(vehicle.start, vehicle.end);
+
+        // vehicle is drawn for t = 0..duration, the last position has to be inside nFrames
+        vehicle.duration = std::max(1, std::min(duration(rng), params.nFrames - 1));
+        int lastFirstFrame = std::max(0, params.nFrames - 1 - vehicle.duration);
+        vehicle.firstFrame = std::uniform_int_distribution<int>(0, lastFirstFrame)(rng);
+
+        vehicles.push_back(vehicle);
+    }
+}
+
+void SyntheticScene::drawVehicle(Mat& frame, const Vehicle& vehicle, float progress)
+{
+    Point2f centre = vehicle.start + (vehicle.end - vehicle.start) * progress;
+    Rect body(centre.x - vehicle.size.width / 2, centre.y - vehicle.size.height / 2, 
+              vehicle.size.width, vehicle.size.height);
+    Rect frameRect(Point(0, 0), frame.size());
+
+    // cast shadow: darker, but with the same chromaticity as background
+    Rect shadow = Rect(body.x + body.width / 3, body.y + body.height / 4, body.width, body.height) & frameRect;
+    if (shadow.area() > 0)
+    {
+        Mat shadowRoi = frame(shadow);
+        shadowRoi.convertTo(shadowRoi, -1, 0.55);
+    }
+
+    rectangle(frame, body & frameRect, vehicle.colour, FILLED);
+
+    // windows, so that tracker has some corners to follow
+    Rect window(body.x + body.width / 5, body.y + body.height / 5, body.width * 3 / 5, body.height / 4);
+    rectangle(frame, window & frameRect, vehicle.colour * 0.3, FILLED);
+}
+
+bool SyntheticScene::nextFrame(OutputArray _frame)
+{
+    if (frameCounter >= params.nFrames)
+        return false;
+
+    // slow illumination drift, period of 500 frames
+    double gain = 1.0 + 0.08 * std::sin(2 * M_PI * frameCounter / 500.0);
+    _frame.create(params.frameSize, CV_8UC3);
+    Mat frame = _frame.getMat();
+    background.convertTo(frame, -1, gain);
+
+    for (const Vehicle& vehicle: vehicles)
+    {
+        int t = frameCounter - vehicle.firstFrame;
+        if (t >= 0 && t <= vehicle.duration)
+            drawVehicle(frame, vehicle, float(t) / vehicle.duration);
+    }
+
+    size_t noiseIdx = frameCounter % noisePositive.size();
+    add(frame, noisePositive[noiseIdx], frame);
+    subtract(frame, noiseNegative[noiseIdx], frame);
+
+    frameCounter++;
+    return true;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,64 @@
+#ifndef SYNTHETICSCENE_H
+#define SYNTHETICSCENE_H
+
+#include <opencv2/core.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+struct SyntheticSceneParameters
+{
+    Size frameSize;
+    int nObjects, nFrames;
+    uint32_t seed = 1;
+
+    // "WIDTHxHEIGHT,OBJECTS,FRAMES[,SEED]"
+    bool parse(const std::string& spec);
+};
+
+// deterministic traffic scene: textured background with noise and slow illumination drift,
+// and rectangular vehicles with cast shadows that cross both counting lines. 
+// every vehicle enters and leaves the frame within nFrames, so ground truth counts are
+// known in advance.
+class SyntheticScene
+{
+    public:
+        // lines: 4 points of the two counting lines, normalized to [0, 1] like in .json files
+        SyntheticScene(const SyntheticSceneParameters& params, const std::vector<Point2f>& lines);
+
+        // returns false after the last frame
+        bool nextFrame(OutputArray _frame);
+        int frameNumber() const { return frameCounter; }
+
+        // vehicles going from line #0 to line #1 and the other way round
+        int naturalCount() const { return nNatural; }
+        int oppositeCount() const { return params.nObjects - nNatural; }
+
+    private:
+        struct Vehicle
+        {
+            Point2f start, end;
+            int firstFrame, duration;
+            Size size;
+            Scalar colour;
+        };
+
+        SyntheticSceneParameters params;
+        std::mt19937 rng;
+        Mat background;
+        // noise is precomputed, split into positive and negative part for saturated add/subtract
+        std::vector<Mat> noisePositive, noiseNegative;
+        std::vector<Vehicle> vehicles;
+        int nNatural = 0;
+        int frameCounter = 0;
+
+        void createBackground();
+        void createVehicles(const std::vector<Point2f>& lines);
+        void drawVehicle(Mat& frame, const Vehicle& vehicle, float progress);
+};
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
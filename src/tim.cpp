@@ -1,11 +1,16 @@
-#include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <thread>
 #include <nanomsg/pair.h>
 #include "tim.h"
+#ifdef FRAME_POOL
+#include "framepool.h"
+#endif
 #include "json11.hpp"
+#include "trace.h"
 
 using namespace json11;
 
@@ -14,6 +19,15 @@ Tim::~Tim()
     if (background) delete background;
     if (shadows) delete shadows;
     if (classifier) delete classifier;
+    if (loopDetector) delete loopDetector;
+    if (scene) delete scene;
+    if (scheduler) delete scheduler;
+    if (metricsPublisher) delete metricsPublisher;
+    if (eventPublisher) delete eventPublisher;
+    // control thread uses the socket, so it has to be stopped first
+    if (control) delete control;
+    if (display) delete display;
+    if (recorder) delete recorder;
 
     nn_close(socket);
     std::remove("/tmp/tim.path");
@@ -26,6 +40,14 @@ bool Tim::open(const TimParameters& parameters)
 #endif
 
     this->params = parameters;
+#ifdef TRACE
+    Trace::init();
+#endif
+#ifdef FRAME_POOL
+    // every Mat allocated from now on reuses buffers released in previous frames
+    Mat::setDefaultAllocator(FramePool::instance());
+#endif
+
     // open .json file and parse it
     string jsonFileName = DATA_DIR + params.fileName + ".json"; 
     ifstream jsonFile(jsonFileName, ifstream::in);
@@ -45,15 +67,51 @@ bool Tim::open(const TimParameters& parameters)
     params.removeShadows = json["shadowDetection"].bool_value();
     double startTime = json["startTime"].number_value();
     std::string naturalDirection = json["naturalDirection"].string_value();
-    
-    // open video file
-    string videoFileName = DATA_DIR + params.fileName + ".mp4"; 
-    videoCapture.open(videoFileName);
-    if (!videoCapture.isOpened())
+
+    // classifier, loop detector and synthetic scene all expect two counting lines of two [x, y] points
+    const Json::array& linesJson = json["lines"].array_items();
+    if (linesJson.size() != 4 || std::any_of(linesJson.begin(), linesJson.end(),
+                                             [](const Json& pt) { return pt.array_items().size() != 2; }))
     {
-        cout << "could not open video file" << endl;
+        cout << "expected two counting lines (4 points [x, y]) in " << jsonFileName << endl;
         return false;
     }
+    
+    double width, height;
+    if (!params.synthetic.empty())
+    {
+        // generated scene replaces the video, it uses counting lines from .json file
+        SyntheticSceneParameters sceneParams;
+        if (!sceneParams.parse(params.synthetic))
+        {
+            cout << "invalid synthetic scene, expected WIDTHxHEIGHT,OBJECTS,FRAMES[,SEED]" << endl;
+            return false;
+        }
+
+        std::vector<Point2f> lines;
+        for (const Json& list: json["lines"].array_items())
+            lines.emplace_back(list[0].number_value(), list[1].number_value());
+
+        scene = new SyntheticScene(sceneParams, lines);
+        width = sceneParams.frameSize.width;
+        height = sceneParams.frameSize.height;
+    }
+    else
+    {
+        // open video file
+        string videoFileName = DATA_DIR + params.fileName + ".mp4"; 
+        videoCapture.open(videoFileName);
+        if (!videoCapture.isOpened())
+        {
+            cout << "could not open video file" << endl;
+            return false;
+        }
+
+        width = videoCapture.get(CV_CAP_PROP_FRAME_WIDTH);
+        height = videoCapture.get(CV_CAP_PROP_FRAME_HEIGHT);
+        fps = videoCapture.get(CV_CAP_PROP_FPS);
+        videoCapture.set(CV_CAP_PROP_POS_MSEC, startTime * 1000);
+    }
 
     // create temporary file containing full path to .json,
     // so that I don't have to specify anything when running Python scripts
@@ -66,23 +124,69 @@ bool Tim::open(const TimParameters& parameters)
     socket = nn_socket(AF_SP, NN_PAIR);
     if (socket >= 0)
         nn_connect(socket, "ipc:///tmp/tim.ipc");
+
+    if (params.metrics)
+    {
+        metricsPublisher = new MetricsPublisher(metrics, "ipc:///tmp/tim-metrics.ipc");
+        if (!metricsPublisher->isOpened())
+            cout << "could not open metrics socket" << endl;
+    }
+
+    if (params.eventStream >= 0)
+    {
+        eventPublisher = new EventPublisher("ipc:///tmp/tim-events.ipc", params.eventStream);
+        if (!eventPublisher->isOpened())
+            cout << "could not open events socket" << endl;
+    }
     
-    auto width = videoCapture.get(CV_CAP_PROP_FRAME_WIDTH);
-    auto height = videoCapture.get(CV_CAP_PROP_FRAME_HEIGHT);
-    auto fps = videoCapture.get(CV_CAP_PROP_FPS);
-    videoCapture.set(CV_CAP_PROP_POS_MSEC, startTime * 1000);
     this->frameSize = Size(width * scaleFactor, height * scaleFactor);
 
     if (params.record)
     {
-        videoWriter.open("demo.avi", VideoWriter::fourcc('X','V','I','D'), fps, Size(width, height));
-        if (!videoWriter.isOpened())
+        recorder = new Recorder("demo.avi", fps, frameSize, params.recordAnnotatedOnly, params.recordBlock);
+        if (!recorder->isOpened())
         {
             cout << "could not open output video file" << endl;
             return false;
         }
     }
 
+    // recording being replayed can't be appended to at the same time
+    if (params.replay)
+        params.recordMasks = false;
+
+    if (!params.eventLog.empty() &&
+        !eventLog.open(params.eventLog, params.eventStream >= 0 ? params.eventStream : 0))
+        return false;
+
+    if (params.recordMasks && !maskWriter.open("foreground.masks", frameSize))
+    {
+        cout << "could not open foreground.masks (it might be a recording of a different size)" << endl;
+        return false;
+    }
+
+    if (params.replay)
+    {
+        if (!maskReader.open("foreground.masks") || maskReader.frameSize() != frameSize || 
+                maskReader.frameCount() == 0)
+        {
+            cout << "could not open foreground.masks (or it was recorded from a different video)" << endl;
+            return false;
+        }
+
+        // background planes are optional, without them shadows can't be removed
+        replayBackground = Mat::zeros(frameSize, CV_8UC3);
+        replayStdDev = Mat::zeros(frameSize, CV_32F);
+        uint32_t planes = maskReader.entry(0).planes;
+        if (!(planes & MaskRecording::BACKGROUND) || !(planes & MaskRecording::STDDEV))
+        {
+            shadowsAllowed = false;
+            params.removeShadows = false;
+        }
+        if (!(planes & MaskRecording::FRAME))
+            videoCapture.set(CV_CAP_PROP_POS_MSEC, maskReader.entry(0).timestamp);
+    }
+
     // prepare ROI mask
     roiMask = Mat::zeros(frameSize, CV_8U);
     std::vector<Point> roiPoints, roiPolygon;
@@ -107,9 +211,18 @@ bool Tim::open(const TimParameters& parameters)
     background = new Background(frameSize, json);
     shadows = new Shadows(json);
     classifier = new Classifier(linesPoints, naturalDirection);
+    if (params.loopCounting)
+        loopDetector = new LoopDetector(frameSize, linesPoints, naturalDirection, json);
 
+    // benchmark results shouldn't depend on parameters tuned in the meantime
     if (!params.benchmark)
-        namedWindow("OpenCV", WINDOW_AUTOSIZE);
+    {
+        display = new Display();
+        if (socket >= 0)
+            control = new ControlChannel(socket);
+        if (params.realtime)
+            scheduler = new RealtimeScheduler(fps);
+    }
     else
         std::cout << "benchmark mode" << std::endl;
 
@@ -118,119 +231,409 @@ bool Tim::open(const TimParameters& parameters)
 
 void Tim::processFrames()
 {
-    Mat inputFrame, foregroundMask = Mat::zeros(frameSize, CV_8U), shadowMask, displayFrame, bgModel;
+    Mat capturedFrame, inputFrame, foregroundMask = Mat::zeros(frameSize, CV_8U), shadowMask;
+
+    bool track = trackingEnabled();
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
     while (true)
     {
+        TIM_TRACE_SCOPE("frame");
+
+        // parameters are replaced only here, so every stage sees the same snapshot for the whole frame
+        if (control)
+        {
+            if (std::unique_ptr<ParameterSnapshot> snapshot = control->poll())
+                applyParameters(*snapshot);
+        }
+
+        // in real-time mode, optional stages or the whole frame are skipped when running late
+        RealtimeScheduler::Decision decision = RealtimeScheduler::FULL;
+        if (scheduler)
+        {
+            if (paused)
+                scheduler->restart();
+            else
+                decision = scheduler->beginFrame();
+
+            if (decision == RealtimeScheduler::SKIP)
+            {
+                if (!skipFrame(capturedFrame))
+                    break;
+                frameCount++;
+                metrics.framesSkipped.store(scheduler->framesSkipped(), std::memory_order_relaxed);
+                continue;
+            }
+            metrics.framesDegraded.store(scheduler->framesDegraded(), std::memory_order_relaxed);
+        }
+        bool removeShadows = params.removeShadows && !params.loopCounting && decision == RealtimeScheduler::FULL;
+        bool classifyColours = params.classifyColours && decision == RealtimeScheduler::FULL;
+
+        stageTimer.startFrame();
+#ifdef TRACE
+        Trace::dumpIfRequested("tim.trace.json");
+#endif
+
         if(!paused)
         {
             frameCount++;
-            videoCapture >> inputFrame;
-            resize(inputFrame, inputFrame, Size(), scaleFactor, scaleFactor);
-            
+            if (params.benchmark && frameCount == uint32_t(params.benchmarkWarmup) + 1)
+            {
+                t1 = std::chrono::high_resolution_clock::now();
+#ifdef PERF_COUNTERS
+                background->getWorkerCounters().reset();
+                shadows->getWorkerCounters().reset();
+#endif
+            }
+
+            if (params.replay)
+            {
+                // foreground mask comes from recording, background substraction is skipped
+                if (!replayFrame(capturedFrame, inputFrame, foregroundMask))
+                    break;
+                shadowRatio.release();
+                stageTimer.lap(StageTimer::DECODE);
+            }
+            else
+            {
+                // resizing into a separate buffer, in-place resize would allocate new one every frame
+                if (!readFrame(capturedFrame))
+                    break;
+                stageTimer.lap(StageTimer::DECODE);
+
+                {
+                    TIM_TRACE_SCOPE("resize");
+                    resize(capturedFrame, inputFrame, frameSize);
+                }
+                stageTimer.lap(StageTimer::RESIZE);
+
 #ifdef SIMD
-            background->processFrameSIMD(inputFrame, foregroundMask);
+                // let background kernel calculate ratio needed by shadow removal in the same pass
+                if (removeShadows && shadows->needsRatio())
+                    background->processFrameSIMD(inputFrame, foregroundMask, shadowRatio);
+                else
+                {
+                    background->processFrameSIMD(inputFrame, foregroundMask);
+                    shadowRatio.release();
+                }
 #else
-            background->processFrame(inputFrame, foregroundMask);
+                background->processFrame(inputFrame, foregroundMask);
 #endif
-            foregroundMask &= roiMask;
-            detectMovingObjects(foregroundMask);
+                stageTimer.lap(StageTimer::BACKGROUND);
+
+                background->filterForeground(foregroundMask);
+                foregroundMask &= roiMask;
+                stageTimer.lap(StageTimer::POSTFILTER);
+
+                double timestamp = currentTimestamp();
+                if (params.recordMasks && params.recordFrames)
+                    maskWriter.write(foregroundMask, frameCount, timestamp, background->getCurrentBackground(),
+                                     background->getCurrentStdDev(), inputFrame);
+                else if (params.recordMasks)
+                    maskWriter.write(foregroundMask, frameCount, timestamp);
+                if (params.recordMasks)
+                    stageTimer.lap(StageTimer::RECORDING);
+            }
+
+            // loop counting works directly on foreground mask, objects are neither
+            // segmented nor tracked
+            if (params.loopCounting)
+            {
+                loopDetector->processFrame(foregroundMask);
+                stageTimer.lap(StageTimer::COUNTING);
+            }
+            else
+            {
+                detectMovingObjects(foregroundMask);
+                stageTimer.lap(StageTimer::CCL);
+            }
         }
 
         if (paused)
         {
             movingObjects = movingObjectsCopy;
-            objectLabels = objectLabelsCopy.clone();
+            objectLabelsCopy.copyTo(objectLabels);
         }
 
-        shadowMask = Mat::zeros(frameSize, CV_8U);
-        if (params.removeShadows)
+        const Mat& currentBackground = params.replay ? replayBackground : background->getCurrentBackground();
+        const Mat& currentStdDev = params.replay ? replayStdDev : background->getCurrentStdDev();
+
+        shadowMask.create(frameSize, CV_8U);
+        shadowMask.setTo(0);
+        if (removeShadows)
         {
-            shadows->removeShadows(inputFrame, background->getCurrentBackground(), 
-                                   background->getCurrentStdDev(), foregroundMask, 
-                                   objectLabels, movingObjects, shadowMask);
+            shadows->removeShadows(inputFrame, currentBackground, currentStdDev, foregroundMask, 
+                                   objectLabels, movingObjects, shadowMask, shadowRatio);
+            stageTimer.lap(StageTimer::SHADOWS);
+        }
+
+        if (!paused && track)
+        {
+            Mat mask = removeShadows ? (shadowMask == 2) : foregroundMask;
+            classifier->trackObjects(inputFrame, mask, movingObjects);
+            stageTimer.lap(StageTimer::TRACKING);
+
+            classifier->checkCollisions();
+            classifier->updateCounters();
+            stageTimer.lap(StageTimer::COUNTING);
+
+            if (classifyColours)
+            {
+                classifier->classifyColours(inputFrame);
+                stageTimer.lap(StageTimer::COLOURS);
+            }
+        }
+
+        stageTimer.endFrame(params.benchmark && !paused && frameCount > uint32_t(params.benchmarkWarmup));
+
+        if (!paused)
+        {
+            uint32_t naturalCount = loopDetector ? loopDetector->naturalCount() : classifier->naturalCount();
+            uint32_t oppositeCount = loopDetector ? loopDetector->oppositeCount() : classifier->oppositeCount();
+            const std::vector<Crossing>& crossings = loopDetector ? loopDetector->lastCrossings() :
+                                                                    classifier->lastCrossings();
+
+            metrics.observeFrame(stageTimer);
+            metrics.activeTracks.store(track ? classifier->activeTracks() : 0, std::memory_order_relaxed);
+            metrics.naturalCount.store(naturalCount, std::memory_order_relaxed);
+            metrics.oppositeCount.store(oppositeCount, std::memory_order_relaxed);
+            if (recorder)
+                metrics.recorderDroppedFrames.store(recorder->framesDropped(), std::memory_order_relaxed);
+
+            if (eventPublisher)
+                eventPublisher->publish(frameCount, currentTimestamp(), crossings);
+            if (eventLog.isOpened())
+            {
+                CrossingEvents::toLogRecords(crossings, logRecords);
+                eventLog.write(frameCount, logRecords, naturalCount, oppositeCount);
+            }
         }
 
         if (!params.benchmark)
         {
-            Mat foregroundMaskBGR, row1, row2;
+            DisplayViews& views = display->backBuffer();
+            Mat& displayFrame = views.frame;
 
             inputFrame.copyTo(displayFrame);
-            if (!paused)
+
+            if (params.loopCounting)
             {
-                Mat mask = params.removeShadows ? (shadowMask == 2) : foregroundMask;
-                if (!params.dontTrack)
-                {
-                    classifier->trackObjects(displayFrame, mask, movingObjects);
-                    classifier->checkCollisions();
-                    classifier->updateCounters();
-                    if (params.classifyColours)
-                        classifier->classifyColours(displayFrame);
-                }
+                loopDetector->drawLoops(displayFrame);
+                loopDetector->drawCounters(displayFrame);
             }
-
-            if (!params.dontTrack)
+            else if (!params.dontTrack)
             {
                 classifier->drawBoundingBoxes(displayFrame, params.classifyColours);
                 classifier->drawCollisionLines(displayFrame);
                 classifier->drawCounters(displayFrame);
             }
 
-            cvtColor(foregroundMask * 255, foregroundMaskBGR, COLOR_GRAY2BGR);
-            hconcat(displayFrame, foregroundMaskBGR, row1);
-
-            cvtColor(shadowMask * (255/2), shadowMask, COLOR_GRAY2BGR);
+            foregroundMask.copyTo(views.foregroundMask);
+            currentBackground.copyTo(views.background);
+            shadowMask.copyTo(views.shadowMask);
 
-            hconcat(background->getCurrentBackground(), shadowMask, row2);
-            vconcat(row1, row2, displayFrame);
-            imshow("OpenCV", displayFrame);
-            
+            // encoding runs on recorder's thread
             if(params.record)
-                videoWriter << displayFrame;
+                recorder->push(views);
+
+            // render thread picks up the latest published frame at its own pace
+            display->publish();
         }
         
-        if (params.benchmark && frameCount == BENCHMARK_FRAMES_NUM)
+        if (scheduler && !paused)
+            scheduler->endFrame(decision);
+
+        if (params.benchmark && stageTimer.framesRecorded() == size_t(params.benchmarkFrames))
             break;
 
         if (!params.benchmark)
         {
-            char key = waitKey(30);
-            if(key == 'q')
-                break;
-            else if (key == ' ')
-                paused = !paused;
-            else if (key == 's')
-                params.removeShadows = !params.removeShadows;
-
-            // check if parameters got updated
-            void *buf = NULL;
-            int nbytes = nn_recv(socket, &buf, NN_MSG, NN_DONTWAIT);
-            if (nbytes > 0)
+            bool quit = false;
+            char key;
+            while (display->pollKey(key))
             {
-                std::string jsonString((const char*)buf, nbytes), err;
-                auto json = Json::parse(jsonString, err);
-                shadows->updateParameters(json);
-                background->updateParameters(json);
-                params.removeShadows = json["shadowDetection"].bool_value();
-                nn_freemsg(buf);
+                if(key == 'q')
+                    quit = true;
+                else if (key == ' ')
+                    paused = !paused;
+                else if (key == 's')
+                    params.removeShadows = !params.removeShadows && shadowsAllowed;
             }
+
+            if (quit)
+                break;
+
+            // when paused, the same frame is reprocessed only to reflect parameter changes
+            if (paused)
+                std::this_thread::sleep_for(std::chrono::milliseconds(30));
         }
     }
 
     auto t2 = std::chrono::high_resolution_clock::now();
+#ifdef TRACE
+    Trace::dump("tim.trace.json");
+#endif
     if (params.benchmark)
     {
         auto time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
-        std::cout << "processed " << BENCHMARK_FRAMES_NUM << " frames in " << time_span.count() 
+        size_t frames = stageTimer.framesRecorded();
+        std::cout << "processed " << frames << " frames in " << time_span.count() 
                   << " seconds." << std::endl;
-        std::cout << "average " << BENCHMARK_FRAMES_NUM / time_span.count() << " fps. " << std::endl;
+        std::cout << "average " << frames / time_span.count() << " fps. " << std::endl;
+#ifdef PERF_COUNTERS
+        stageTimer.addWorkerCounters("background workers", background->getWorkerCounters().total());
+        stageTimer.addWorkerCounters("shadows workers", shadows->getWorkerCounters().total());
+#endif
+        stageTimer.printReport();
+
+        if (!params.benchmarkReport.empty())
+            writeBenchmarkReport(time_span.count());
+    }
+
+    // synthetic scene knows how many vehicles really crossed the lines
+    if (scene && (track || params.loopCounting))
+    {
+        uint32_t natural = loopDetector ? loopDetector->naturalCount() : classifier->naturalCount();
+        uint32_t opposite = loopDetector ? loopDetector->oppositeCount() : classifier->oppositeCount();
+        std::cout << "natural direction: counted " << natural << ", ground truth " 
+                  << scene->naturalCount() << std::endl;
+        std::cout << "opposite direction: counted " << opposite << ", ground truth " 
+                  << scene->oppositeCount() << std::endl;
     }
+
+    if (recorder)
+    {
+        recorder->finish();
+        std::cout << "recorded " << recorder->framesWritten() << " frames, dropped " 
+                  << recorder->framesDropped() << " frames." << std::endl;
+    }
+
+    if (scheduler)
+        scheduler->printReport();
+}
+
+bool Tim::trackingEnabled() const
+{
+    // in benchmark mode tracking is skipped unless asked for, as it isn't needed without display
+    return !params.dontTrack && !params.loopCounting && (!params.benchmark || params.benchmarkTracking);
+}
+
+void Tim::writeBenchmarkReport(double seconds)
+{
+    size_t frames = stageTimer.framesRecorded();
+    Json report = Json::object
+    {
+        { "file", params.fileName },
+        { "frameSize", Json::array { frameSize.width, frameSize.height } },
+        { "frames", int(frames) },
+        { "warmup", params.benchmarkWarmup },
+        { "seconds", seconds },
+        { "fps", frames / seconds },
+        { "options", Json::object 
+            {
+                { "tracking", trackingEnabled() },
+                { "loopCounting", params.loopCounting },
+                { "removeShadows", params.removeShadows },
+                { "replay", params.replay },
+#ifdef SIMD
+                { "simd", true },
+#else
+                { "simd", false },
+#endif
+#ifdef MULTITHREADING
+                { "multithreading", true },
+#else
+                { "multithreading", false },
+#endif
+            } 
+        },
+        { "latency", stageTimer.jsonReport() }
+    };
+
+    std::ofstream file(params.benchmarkReport);
+    file << report.dump() << std::endl;
+    if (!file)
+        std::cout << "could not write " << params.benchmarkReport << std::endl;
+}
+
+bool Tim::readFrame(Mat& capturedFrame)
+{
+    TIM_TRACE_SCOPE("decode");
+    if (scene)
+        return scene->nextFrame(capturedFrame);
+
+    videoCapture >> capturedFrame;
+    return !capturedFrame.empty();
+}
+
+void Tim::applyParameters(const ParameterSnapshot& snapshot)
+{
+    background->setParameters(snapshot.background);
+    shadows->setParameters(snapshot.shadows);
+    if (loopDetector)
+        loopDetector->setParameters(snapshot.loops);
+    // control channel can't turn shadows on in a replay that has no background planes
+    params.removeShadows = snapshot.removeShadows && shadowsAllowed;
+}
+
+double Tim::currentTimestamp()
+{
+    return scene ? scene->frameNumber() * 1000.0 / fps : videoCapture.get(CV_CAP_PROP_POS_MSEC);
+}
+
+bool Tim::skipFrame(Mat& capturedFrame)
+{
+    TIM_TRACE_SCOPE("skip");
+    if (params.replay)
+    {
+        if (replayPosition >= maskReader.frameCount())
+            return false;
+
+        // video is advanced only for frames that were decoded from it
+        if (maskReader.entry(replayPosition++).planes & MaskRecording::FRAME)
+            return true;
+    }
+
+    // synthetic scene has to generate every frame to stay deterministic
+    if (scene)
+        return scene->nextFrame(capturedFrame);
+
+    return videoCapture.grab();
+}
+
+bool Tim::replayFrame(Mat& capturedFrame, Mat& frame, Mat& fgMask)
+{
+    TIM_TRACE_SCOPE("replay");
+    if (replayPosition >= maskReader.frameCount())
+        return false;
+
+    uint32_t planes = maskReader.entry(replayPosition).planes;
+    if (!maskReader.read(replayPosition++, fgMask, replayBackground, replayStdDev, frame))
+        return false;
+
+    // frames weren't recorded, they're decoded from the video
+    if (!(planes & MaskRecording::FRAME))
+    {
+        if (!readFrame(capturedFrame))
+            return false;
+        resize(capturedFrame, frame, frameSize);
+    }
+
+    return true;
 }
 
 void Tim::detectMovingObjects(InputArray _fgMask)
 {
+    findMovingObjects(_fgMask, objectLabels, movingObjects);
+
+    movingObjectsCopy = movingObjects;
+    objectLabels.copyTo(objectLabelsCopy);
+}
+
+void Tim::findMovingObjects(InputArray _fgMask, Mat& objectLabels, std::vector<MovingObject>& movingObjects)
+{
+    TIM_TRACE_SCOPE("ccl");
     Mat fgMask = _fgMask.getMat();
     movingObjects.clear();
 
@@ -254,9 +657,6 @@ void Tim::detectMovingObjects(InputArray _fgMask)
 
     for (auto& obj: movingObjects)
         obj.minimizeMask();
-
-    movingObjectsCopy = movingObjects;
-    objectLabelsCopy = objectLabels.clone();
 }
 
 /* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
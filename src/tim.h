@@ -6,9 +6,18 @@
 #include <string>
 #include "background.h"
 #include "classifier.h"
+#include "control.h"
+#include "crossingevents.h"
+#include "display.h"
+#include "eventlog.h"
+#include "loopdetector.h"
+#include "maskrecording.h"
+#include "metrics.h"
+#include "realtime.h"
+#include "recorder.h"
 #include "shadows.h"
-
-#define BENCHMARK_FRAMES_NUM 400
+#include "stagetimer.h"
+#include "syntheticscene.h"
 
 using namespace std;
 
@@ -16,9 +25,37 @@ struct TimParameters
 {
     std::string fileName;
     bool benchmark;
+    // number of measured frames and frames processed before measuring starts
+    int benchmarkFrames, benchmarkWarmup;
+    // run tracking and counting in benchmark mode too
+    bool benchmarkTracking;
+    // JSON report is written only if not empty
+    std::string benchmarkReport;
+    // "WIDTHxHEIGHT,OBJECTS,FRAMES[,SEED]", generated scene is used instead of video if not empty
+    std::string synthetic;
+    // publish metrics on ipc:///tmp/tim-metrics.ipc
+    bool metrics;
+    // publish crossing events on ipc:///tmp/tim-events.ipc with this stream ID, -1 to disable
+    int eventStream;
+    // append crossings and count snapshots to memory-mapped log <eventLog>.<number>.tlog
+    std::string eventLog;
+    // pace processing to video frame rate and skip work when falling behind
+    bool realtime;
     bool record;
+    // record only annotated frame instead of the 2x2 debug view
+    bool recordAnnotatedOnly;
+    // wait for encoder instead of dropping frames when it falls behind
+    bool recordBlock;
+    // append ROI-masked foreground masks to foreground.masks
+    bool recordMasks;
+    // store also background and frame with masks, so that replay can remove shadows and doesn't
+    // have to decode the video (the video file still has to exist, it's opened anyway)
+    bool recordFrames;
+    // take foreground masks from foreground.masks instead of background substraction
+    bool replay;
     bool classifyColours;
     bool dontTrack;
+    bool loopCounting;
     bool removeShadows = false;
 };
 
@@ -29,27 +66,58 @@ class Tim
         bool open(const TimParameters& params);
         void processFrames();
 
+        // segments foreground mask into moving objects, tiny ones are dropped
+        static void findMovingObjects(InputArray _fgMask, Mat& objectLabels, 
+                std::vector<MovingObject>& movingObjects);
+
     private:
         TimParameters params;
         const double scaleFactor = .5;
 
         bool paused = false;
+        // false when replaying a recording without background, shadows can't be removed then
+        bool shadowsAllowed = true;
         uint32_t frameCount = 0;
+        StageTimer stageTimer;
+        Metrics metrics;
+        MetricsPublisher* metricsPublisher = nullptr;
+        EventPublisher* eventPublisher = nullptr;
+        ControlChannel* control = nullptr;
+        RealtimeScheduler* scheduler = nullptr;
 
         Background* background = nullptr;
         Shadows* shadows = nullptr;
         Classifier* classifier = nullptr;
+        LoopDetector* loopDetector = nullptr;
+        SyntheticScene* scene = nullptr;
+        Display* display = nullptr;
+        Recorder* recorder = nullptr;
+        MaskWriter maskWriter;
+        EventLogWriter eventLog;
+        std::vector<EventLog::Record> logRecords;
+        MaskReader maskReader;
+        size_t replayPosition = 0;
+        Mat replayBackground, replayStdDev;
         VideoCapture videoCapture;
-        VideoWriter videoWriter;
+        double fps = 25;
         Size frameSize;
         Mat roiMask, objectLabels, objectLabelsCopy;
+        // background/frame ratio calculated by background kernel for shadow removal
+        Mat shadowRatio;
 
         // a copy is needed when playback is paused, but we want to update shadow detection params
         std::vector<MovingObject> movingObjects, movingObjectsCopy;
 
         int socket;
 
+        bool readFrame(Mat& capturedFrame);
+        bool skipFrame(Mat& capturedFrame);
+        double currentTimestamp();
+        void applyParameters(const ParameterSnapshot& snapshot);
+        bool replayFrame(Mat& capturedFrame, Mat& frame, Mat& fgMask);
         void detectMovingObjects(InputArray _fgMask);
+        bool trackingEnabled() const;
+        void writeBenchmarkReport(double seconds);
 };
 
 #endif
@@ -0,0 +1,89 @@
+#include "trace.h"
+
+#ifdef TRACE
+
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace Trace
+{
+
+static std::mutex registryMutex;
+static std::vector<ThreadBuffer*> registry;
+static std::atomic<bool> dumpRequested(false);
+
+uint64_t now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+ThreadBuffer& threadBuffer()
+{
+    // buffers are never freed, so that events of threads that already finished can be dumped
+    thread_local ThreadBuffer* buffer = []
+    {
+        ThreadBuffer* buffer = new ThreadBuffer();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->tid = registry.size() + 1;
+        registry.push_back(buffer);
+        return buffer;
+    }();
+
+    return *buffer;
+}
+
+static void onSignal(int)
+{
+    dumpRequested = true;
+}
+
+void init()
+{
+    now();
+    std::signal(SIGUSR1, onSignal);
+}
+
+void dump(const std::string& fileName)
+{
+    std::ofstream file(fileName);
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+
+    bool first = true;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (ThreadBuffer* buffer: registry)
+    {
+        // other threads might still be writing. events that get overwritten
+        // while they're being copied can be garbled, the rest is consistent.
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t tail = head > ThreadBuffer::capacity ? head - ThreadBuffer::capacity : 0;
+
+        for (uint64_t idx = tail; idx < head; idx++)
+        {
+            const Event& event = buffer->events[idx & (ThreadBuffer::capacity - 1)];
+            file << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1"
+                 << ",\"tid\":" << buffer->tid << ",\"ts\":" << event.start / 1e3 
+                 << ",\"dur\":" << (event.end - event.start) / 1e3 << "}";
+            first = false;
+        }
+    }
+
+    file << "\n]}" << std::endl;
+    std::cout << "trace written to " << fileName << std::endl;
+}
+
+void dumpIfRequested(const std::string& fileName)
+{
+    if (dumpRequested.exchange(false))
+        dump(fileName);
+}
+
+}
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
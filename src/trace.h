@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// scoped tracing. TIM_TRACE_SCOPE("stage.name") records start and end of the enclosing scope
+// into a ring buffer of the calling thread. buffers are dumped in Chrome trace format
+// (chrome://tracing, Perfetto) on exit and on SIGUSR1. without TRACE defined it compiles to nothing.
+// names have to be string literals (or otherwise outlive the trace), only pointers are stored.
+
+#ifdef TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Trace
+{
+    struct Event
+    {
+        const char* name;
+        uint64_t start, end;    // nanoseconds since the first event
+    };
+
+    // events of one thread. only the owning thread writes, when it's full the oldest
+    // events get overwritten, so writing never blocks.
+    struct ThreadBuffer
+    {
+        static const uint64_t capacity = 1 << 16;
+
+        Event events[capacity];
+        std::atomic<uint64_t> head{0};
+        int tid;
+
+        void push(const Event& event)
+        {
+            uint64_t idx = head.load(std::memory_order_relaxed);
+            events[idx & (capacity - 1)] = event;
+            head.store(idx + 1, std::memory_order_release);
+        }
+    };
+
+    uint64_t now();
+    // buffer of the calling thread, registered on first use
+    ThreadBuffer& threadBuffer();
+
+    // installs SIGUSR1 handler
+    void init();
+    void dump(const std::string& fileName);
+    // dumps buffers if SIGUSR1 was received since the last call
+    void dumpIfRequested(const std::string& fileName);
+
+    class Scope
+    {
+        public:
+            explicit Scope(const char* name) : name(name), start(now()) {}
+            ~Scope() { threadBuffer().push({ name, start, now() }); }
+
+        private:
+            const char* name;
+            uint64_t start;
+    };
+}
+
+#define TIM_TRACE_CONCAT_(a, b) a##b
+#define TIM_TRACE_CONCAT(a, b) TIM_TRACE_CONCAT_(a, b)
+#define TIM_TRACE_SCOPE(name) Trace::Scope TIM_TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#else
+
+#define TIM_TRACE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,18 @@
+#ifdef MULTITHREADING
+#include <algorithm>
+#include "workerpool.h"
+
+int WorkerPool::size()
+{
+    static const int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    return nThreads;
+}
+
+ThreadPool& WorkerPool::instance()
+{
+    static ThreadPool pool(size());
+    return pool;
+}
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
@@ -0,0 +1,20 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#ifdef MULTITHREADING
+#include "ThreadPool.h"
+
+// worker threads shared by all stages. stages run one after another on processing
+// thread, so a single pool with one thread per core keeps cores busy without
+// oversubscribing them. tasks must not wait for other tasks of the pool.
+namespace WorkerPool
+{
+    ThreadPool& instance();
+    // number of worker threads
+    int size();
+}
+#endif
+
+#endif
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
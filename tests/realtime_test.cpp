@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <iostream>
+#include "realtime.h"
+
+// scheduler driven by simulated time, processing costs are given in periods
+class SimulatedScheduler : public RealtimeScheduler
+{
+    public:
+        SimulatedScheduler(double fps) : RealtimeScheduler(fps) {}
+
+        double time = 0;
+
+    protected:
+        double clock() const override { return time; }
+        void sleep(double seconds) override { time += seconds; }
+};
+
+// returns the largest lag of processing behind the source [periods]
+static double simulate(double fullCost, double degradedCost, double skipCost, int frames)
+{
+    const double fps = 25, period = 1 / fps;
+    SimulatedScheduler scheduler(fps);
+
+    double maxLag = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        RealtimeScheduler::Decision decision = scheduler.beginFrame();
+        maxLag = std::max(maxLag, scheduler.time / period - frame);
+
+        if (decision == RealtimeScheduler::SKIP)
+        {
+            scheduler.time += skipCost * period;
+            continue;
+        }
+        scheduler.time += (decision == RealtimeScheduler::FULL ? fullCost : degradedCost) * period;
+        scheduler.endFrame(decision);
+    }
+
+    return maxLag;
+}
+
+static bool check(const char* name, double maxLag, double limit)
+{
+    bool ok = maxLag <= limit;
+    std::cout << (ok ? "ok   " : "FAIL ") << name << ": max lag " << maxLag << " periods (limit " 
+              << limit << ")" << std::endl;
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    // everything fits
+    ok &= check("no overload", simulate(0.5, 0.2, 0.05, 1000), 1);
+    // only degraded frames fit
+    ok &= check("degraded fits", simulate(1.5, 0.5, 0.05, 1000), 3);
+    // not even degraded frames fit, forced degraded frames used to make lag grow without limit
+    ok &= check("heavy overload", simulate(10, 5, 0.1, 5000), 10);
+
+    return ok ? 0 : 1;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */
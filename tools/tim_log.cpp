@@ -0,0 +1,119 @@
+// reads event log written by 'tim --log=BASENAME' and sums crossings over a time range.
+// usage: tim_log BASENAME [FROM [TO]] [--by=SECONDS] [--snapshots]
+// times are unix timestamps or local time as YYYY-MM-DDTHH:MM[:SS], range is [FROM, TO).
+// --by splits the range into intervals of given length, --snapshots lists count snapshots.
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include "eventlog.h"
+
+static bool parseTime(const std::string& str, double& time)
+{
+    char* end = nullptr;
+    time = strtod(str.c_str(), &end);
+    if (!str.empty() && *end == '\0')
+        return true;
+
+    std::tm tm = {};
+    tm.tm_isdst = -1;
+    const char* rest = strptime(str.c_str(), "%Y-%m-%dT%H:%M", &tm);
+    if (rest && *rest == ':')
+        rest = strptime(rest, ":%S", &tm);
+    if (!rest || *rest != '\0')
+        return false;
+
+    time = double(mktime(&tm));
+    return true;
+}
+
+static std::string formatTime(double time)
+{
+    std::time_t t = std::time_t(time);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    return buffer;
+}
+
+int main(int argc, char** argv)
+{
+    std::string baseName;
+    double from = -std::numeric_limits<double>::infinity(), to = std::numeric_limits<double>::infinity();
+    double by = 0;
+    bool snapshots = false;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 5, "--by=") == 0)
+            by = atof(arg.c_str() + 5);
+        else if (arg == "--snapshots")
+            snapshots = true;
+        else if (positional == 0)
+            baseName = arg, positional++;
+        else if (positional <= 2 && parseTime(arg, positional == 1 ? from : to))
+            positional++;
+        else
+        {
+            std::cout << "invalid argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (baseName.empty())
+    {
+        std::cout << "usage: tim_log BASENAME [FROM [TO]] [--by=SECONDS] [--snapshots]" << std::endl;
+        return 1;
+    }
+
+    EventLogReader reader;
+    if (!reader.open(baseName))
+    {
+        std::cout << "no event log segments found for " << baseName << std::endl;
+        return 1;
+    }
+
+    // intervals are aligned to 'from' if it's given, to unix epoch otherwise
+    double origin = std::isfinite(from) ? from : 0;
+    std::map<double, std::pair<uint64_t, uint64_t>> counts;
+    uint64_t natural = 0, opposite = 0;
+
+    reader.forEach(from, to, [&](const EventLog::Record& record)
+    {
+        if (record.type == EventLog::SNAPSHOT)
+        {
+            if (snapshots)
+                std::cout << formatTime(record.time) << "  frame " << record.frameIndex << "  natural "
+                          << record.naturalCount << "  opposite " << record.oppositeCount << std::endl;
+            return;
+        }
+
+        bool isNatural = record.direction == EventLog::NATURAL;
+        (isNatural ? natural : opposite)++;
+
+        if (by > 0)
+        {
+            double interval = origin + std::floor((record.time - origin) / by) * by;
+            auto& count = counts[interval];
+            (isNatural ? count.first : count.second)++;
+        }
+    });
+
+    if (by > 0)
+        for (auto& count: counts)
+            std::cout << formatTime(count.first) << std::setw(10) << count.second.first
+                      << std::setw(10) << count.second.second << std::endl;
+
+    std::cout << "natural " << natural << ", opposite " << opposite << " (" << reader.segmentsNum()
+              << " segments)" << std::endl;
+
+    return 0;
+}
+
+/* vim: set ft=cpp ts=4 sw=4 sts=4 tw=0 fenc=utf-8 et: */